@@ -2,6 +2,10 @@
  * Big test rabbit.h
  * encrypt - ./bigtest -t 1 -b 1000000 -i file1 -o file2
  * decrypt - ./bigtest -t 2 -b 1000000 -i file2 -o file3
+ * The block sizes of encryption and decryption may differ.
+ * With -c the encrypted file ends with a trailer: the magic "RCRC" and
+ * the CRC32C of the ciphertext (little-endian), computed in the crypt
+ * loop. Decryption with -c checks it.
 */
 
 #include <stdio.h>
@@ -11,8 +15,10 @@
 #include <getopt.h>
 
 #include "rabbit.h"
+#include "rabbit_crc32c.h"
 
 #define MAX_FILE	4096
+#define TRAILER		8
 
 // Allocates memory
 void *
@@ -58,6 +64,7 @@ help(void)
 	printf("\t--block(-b) - block size data read from the file. By default = 10000\n");
 	printf("\t--input(-i) - input file\n");
 	printf("\t--output(-o) - output file\n");
+	printf("\t--crc(-c) - CRC32C trailer: written on encrypt, checked on decrypt\n");
 	printf("Example: ./bigtest -t 1 -b 1000 -i 1.txt -o crypt or ./bigtest -t 2 -b 1000 -i crypt -o decrypt\n\n");
 }
 
@@ -66,16 +73,18 @@ main(int argc, char *argv[])
 {
 	FILE *fp, *fd;
 	struct rabbit_context ctx;
-	uint32_t byte, block = 10000;
-	uint8_t *buf, *out, key[16], iv[8];
+	uint32_t byte, block = 10000, crc = 0;
+	uint8_t *buf, *out, key[16], iv[8], trailer[TRAILER];
 	char file1[MAX_FILE], file2[MAX_FILE];
-	int res, action = 1;
+	int res, action = 1, check = 0;
+	long size = -1;
 
 	const struct option long_option [] = {
 		{"input",  1, NULL, 'i'},
 		{"output", 1, NULL, 'o'},
 		{"block",  1, NULL, 'b'},
 		{"type",   1, NULL, 't'},
+		{"crc",    0, NULL, 'c'},
 		{"help",   0, NULL, 'h'},
 		{0, 	   0, NULL,  0 }
 	};
@@ -85,7 +94,7 @@ main(int argc, char *argv[])
 		return 0;
 	}
 
-	while((res = getopt_long(argc, argv, "i:o:b:t:h", long_option, 0)) != -1) {
+	while((res = getopt_long(argc, argv, "i:o:b:t:ch", long_option, 0)) != -1) {
 		switch(res) {
 		case 'b' : block = atoi(optarg);
 			   break;
@@ -95,6 +104,8 @@ main(int argc, char *argv[])
 			   break;
 		case 't' : action = atoi(optarg);
 			   break;
+		case 'c' : check = 1;
+			   break;
 		case 'h' : help();
 			   return 0;
 		}
@@ -114,13 +125,42 @@ main(int argc, char *argv[])
 		exit(1);
 	}
 	
-	while((byte = fread(buf, 1, block, fp)) > 0) {
-		if(action == 1)
-			rabbit_crypt(&ctx, buf, byte, out);
+	// The trailer is not a part of the ciphertext
+	if(check && action != 1) {
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp) - TRAILER;
+		if(size < 0 || fseek(fp, size, SEEK_SET) || fread(trailer, 1, TRAILER, fp) != TRAILER ||
+			memcmp(trailer, "RCRC", 4)) {
+			printf("No CRC32C trailer in the input file!\n");
+			exit(1);
+		}
+		rewind(fp);
+	}
+
+	while((byte = fread(buf, 1, (size >= 0 && size < block) ? size : block, fp)) > 0) {
+		if(check)
+			crc = rabbit_crypt_stream_crc32c(&ctx, buf, byte, out, crc, action != 1);
 		else
-			rabbit_crypt(&ctx, buf, byte, out);
+			rabbit_crypt_stream(&ctx, buf, byte, out);
 		
 		fwrite(out, 1, byte, fd);
+
+		if(size >= 0)
+			size -= byte;
+	}
+
+	if(check && action == 1) {
+		memcpy(trailer, "RCRC", 4);
+		trailer[4] = crc;
+		trailer[5] = crc >> 8;
+		trailer[6] = crc >> 16;
+		trailer[7] = crc >> 24;
+		fwrite(trailer, 1, TRAILER, fd);
+	} else if(check) {
+		if(crc != (trailer[4] | trailer[5] << 8 | trailer[6] << 16 | (uint32_t)trailer[7] << 24)) {
+			printf("CRC32C mismatch: the input file is corrupted!\n");
+			exit(1);
+		}
 	}
 	
 	free(buf);
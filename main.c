@@ -6,9 +6,28 @@
 #include <string.h>
 #include <sys/time.h>
 
+#define RABBIT_INLINE
 #include "rabbit.h"
+#include "rabbit_session.h"
+#include "rabbit_ring.h"
+#include "rabbit_mb.h"
+#include "rabbit_aead.h"
+#include "rabbit_random.h"
+#include "rabbit_crc32c.h"
+#include "rabbit_pool.h"
 
 #define BUFLEN	10000000
+#define ROUNDS	20
+#define SETUPS	100000
+#define PACKET	64
+#define BATCH	256
+#define CHUNK	1500
+#define JOB	512
+#define RING	(256 * 1024)
+#define HEADER	54
+#define MESSAGE	RABBIT_INLINE_MAX
+#define MESSAGES	1000000
+#define DRAWS	(BUFLEN / 8)
 
 // Struct for time value
 struct timeval t1, t2;
@@ -41,10 +60,80 @@ time_stop(void)
 	return (t2.tv_sec * 1000 + t2.tv_usec/1000);
 }
 
+// Allocates memory, aligned on a cache line
+static void *
+xmalloc(size_t size)
+{
+	void *p = aligned_alloc(64, (size + 63) & ~(size_t)63);
+
+	if(p == NULL) {
+		printf("Allocates memory error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+// Print MB/s of ROUNDS passes over the test buffer
+static void
+print_throughput(int lanes, uint32_t ms)
+{
+	if(ms == 0)
+		ms = 1;
+
+	printf("x%-2d lanes: run time = %u, %.1f MB/s\n", lanes, ms,
+		(double)BUFLEN * ROUNDS / 1000.0 / ms);
+}
+
+// Split the test buffer between n streams
+static void
+streams_setup(struct rabbit_context *ctx, struct rabbit_context **ctx_ptr,
+	const uint8_t **buf_x, uint8_t **out_x, uint32_t *len_x, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++) {
+		if(rabbit_set_key_and_iv(&ctx[i], (uint8_t *)key, 16, iv, 8)) {
+			printf("Rabbit context filling error x%d!\n", n);
+			exit(1);
+		}
+
+		ctx_ptr[i] = &ctx[i];
+		buf_x[i] = buf + i * (BUFLEN / n);
+		out_x[i] = out1 + i * (BUFLEN / n);
+		len_x[i] = BUFLEN / n;
+	}
+}
+
 int
 main()
 {
-	struct rabbit_context ctx;
+	struct rabbit_context ctx, ctx_x[16], *ctx_ptr[16];
+	const uint8_t *buf_x[16];
+	uint8_t *out_x[16];
+	uint32_t len_x[16];
+	struct rabbit_context *setup_ctx;
+	uint8_t (*setup_key)[16], (*setup_iv)[8];
+	struct rabbit_session_table *table;
+	struct rabbit_ring *ring;
+	struct rabbit_mb_mgr *mgr;
+	struct rabbit_job *jobs;
+	struct rabbit_pool *pool;
+	struct rabbit_pool_job *pool_jobs;
+	size_t off, n;
+	uint64_t batch_id[BATCH];
+	const uint8_t *batch_buf[BATCH];
+	uint8_t *batch_out[BATCH];
+	uint32_t batch_len[BATCH];
+	uint8_t batch_iv[BATCH][8];
+	uint8_t tag[RABBIT_AEAD_TAG_SIZE];
+	struct rabbit_rng rng;
+	double *draws;
+	uint32_t crc;
+	uint8_t hdr[HEADER], pkt[HEADER + CHUNK];
+	struct iovec vin[2], vout[1];
+	struct rabbit_master master;
+	int i, j;
 
 	memset(buf, 'q', sizeof(buf));
 	memset(key, 'k', sizeof(key));
@@ -68,6 +157,289 @@ main()
 	
 	printf("Run time = %d\n\n", time_stop());
 
+	// Throughput per lane count over the same amount of data
+	printf("Throughput per lane count:\n");
+
+	streams_setup(ctx_x, ctx_ptr, buf_x, out_x, len_x, 1);
+	time_start();
+	for(i = 0; i < ROUNDS; i++)
+		rabbit_crypt(ctx_ptr[0], buf_x[0], len_x[0], out_x[0]);
+	print_throughput(1, time_stop());
+
+	streams_setup(ctx_x, ctx_ptr, buf_x, out_x, len_x, 8);
+	time_start();
+	for(i = 0; i < ROUNDS; i++)
+		rabbit_crypt_x8(ctx_ptr, buf_x, len_x, out_x);
+	print_throughput(8, time_stop());
+
+	streams_setup(ctx_x, ctx_ptr, buf_x, out_x, len_x, 16);
+	time_start();
+	for(i = 0; i < ROUNDS; i++)
+		rabbit_crypt_x16(ctx_ptr, buf_x, len_x, out_x);
+	print_throughput(16, time_stop());
+
+	printf("\n");
+
+	// Session setup rate: one by one and in bulk
+	setup_ctx = xmalloc(sizeof(*setup_ctx) * SETUPS);
+	setup_key = xmalloc(sizeof(*setup_key) * SETUPS);
+	setup_iv = xmalloc(sizeof(*setup_iv) * SETUPS);
+
+	for(i = 0; i < SETUPS; i++) {
+		memset(setup_key[i], i, sizeof(setup_key[i]));
+		memset(setup_iv[i], i >> 8, sizeof(setup_iv[i]));
+	}
+
+	time_start();
+	for(i = 0; i < SETUPS; i++)
+		rabbit_set_key_and_iv(&setup_ctx[i], setup_key[i], 16, setup_iv[i], 8);
+	printf("Setup of %d contexts: run time = %u\n", SETUPS, time_stop());
+
+	time_start();
+	rabbit_setup_bulk(setup_ctx, (const uint8_t (*)[16])setup_key, (const uint8_t (*)[8])setup_iv, SETUPS);
+	printf("Bulk setup of %d contexts: run time = %u\n\n", SETUPS, time_stop());
+
+	// Session table: one packet per session, one by one and in batches
+	if((table = rabbit_session_table_new(SETUPS)) == NULL) {
+		printf("Session table allocation error!\n");
+		exit(1);
+	}
+
+	for(i = 0; i < SETUPS; i++)
+		rabbit_session_add(table, i, setup_key[i], 16, setup_iv[i], 8);
+
+	time_start();
+	for(i = 0; i < SETUPS; i++)
+		rabbit_session_crypt(table, i, buf + (i % BATCH) * PACKET, PACKET, out1 + (i % BATCH) * PACKET);
+	printf("%d sessions, %d-byte packets: run time = %u\n", SETUPS, PACKET, time_stop());
+
+	for(j = 0; j < BATCH; j++) {
+		batch_buf[j] = buf + j * PACKET;
+		batch_out[j] = out1 + j * PACKET;
+		batch_len[j] = PACKET;
+	}
+
+	time_start();
+	for(i = 0; i + BATCH <= SETUPS; i += BATCH) {
+		for(j = 0; j < BATCH; j++)
+			batch_id[j] = i + j;
+		rabbit_session_crypt_batch(table, batch_id, batch_buf, batch_len, batch_out, BATCH);
+	}
+	printf("%d sessions, %d-byte packets in batches of %d: run time = %u\n\n",
+		SETUPS, PACKET, BATCH, time_stop());
+
+	rabbit_session_table_free(table);
+
+	// Multi-buffer manager: one JOB-byte packet per context, submitted one at a time
+	jobs = xmalloc(sizeof(*jobs) * SETUPS);
+	if((mgr = rabbit_mb_new(0)) == NULL) {
+		printf("Job manager allocation error!\n");
+		exit(1);
+	}
+
+	time_start();
+	for(i = 0; i < SETUPS; i++)
+		rabbit_crypt(&setup_ctx[i], buf + (i % BATCH) * JOB, JOB, out1 + (i % BATCH) * JOB);
+	printf("%d contexts, %d-byte packets: run time = %u\n", SETUPS, JOB, time_stop());
+
+	time_start();
+	for(i = 0; i < SETUPS; i++) {
+		jobs[i].ctx = &setup_ctx[i];
+		jobs[i].buf = buf + (i % BATCH) * JOB;
+		jobs[i].buflen = JOB;
+		jobs[i].out = out2 + (i % BATCH) * JOB;
+		rabbit_mb_submit(mgr, &jobs[i]);
+		while(rabbit_mb_get_completed(mgr) != NULL)
+			;
+	}
+	while(rabbit_mb_flush(mgr) != NULL)
+		;
+	printf("%d contexts, %d-byte packets through the job manager: run time = %u\n\n",
+		SETUPS, JOB, time_stop());
+
+	rabbit_mb_free(mgr);
+	free(jobs);
+
+	// Independent records of 64 to 1500 bytes, one context each: one thread and the pool
+	pool_jobs = xmalloc(sizeof(*pool_jobs) * SETUPS);
+	if((pool = rabbit_pool_new(0)) == NULL) {
+		printf("Thread pool allocation error!\n");
+		exit(1);
+	}
+
+	for(i = 0, off = 0; i < SETUPS; i++) {
+		pool_jobs[i].ctx = &setup_ctx[i];
+		pool_jobs[i].buflen = 64 + (i * 577) % (CHUNK - 63);
+		if(off + pool_jobs[i].buflen > BUFLEN)
+			off = 0;
+		pool_jobs[i].buf = buf + off;
+		pool_jobs[i].out = out1 + off;
+		off += pool_jobs[i].buflen;
+	}
+
+	time_start();
+	for(i = 0; i < SETUPS; i++)
+		rabbit_crypt(pool_jobs[i].ctx, pool_jobs[i].buf, pool_jobs[i].buflen, pool_jobs[i].out);
+	printf("%d records of 64-%d bytes: run time = %u\n", SETUPS, CHUNK, time_stop());
+
+	time_start();
+	rabbit_pool_crypt(pool, pool_jobs, SETUPS);
+	printf("%d records of 64-%d bytes on %d threads: run time = %u\n\n",
+		SETUPS, CHUNK, rabbit_pool_threads(pool), time_stop());
+
+	rabbit_pool_free(pool);
+	free(pool_jobs);
+
+	// Packets of 64 to 1500 bytes under one key, one IV per packet
+	for(j = 0; j < BATCH; j++) {
+		batch_buf[j] = buf + j * CHUNK;
+		batch_out[j] = out1 + j * CHUNK;
+		batch_len[j] = 64 + (j * 577) % (CHUNK - 63);
+		memset(batch_iv[j], j, sizeof(batch_iv[j]));
+	}
+
+	time_start();
+	for(i = 0; i < SETUPS; i += BATCH)
+		for(j = 0; j < BATCH; j++) {
+			rabbit_set_key_and_iv(&ctx, key, 16, batch_iv[j], 8);
+			rabbit_crypt(&ctx, batch_buf[j], batch_len[j], batch_out[j]);
+		}
+	printf("%d packets of 64-%d bytes, key and IV setup each: run time = %u\n", SETUPS, CHUNK, time_stop());
+
+	time_start();
+	rabbit_key_setup(&master, key, 16);
+	for(i = 0; i < SETUPS; i += BATCH)
+		rabbit_crypt_packets(&master, (const uint8_t (*)[8])batch_iv, batch_buf, batch_len, batch_out, BATCH);
+	printf("%d packets of 64-%d bytes, one key in batches of %d: run time = %u\n\n",
+		SETUPS, CHUNK, BATCH, time_stop());
+
+	// Whole buffer as 4 KiB sectors, the same key and IV as the stream
+	time_start();
+	rabbit_crypt_sectors(&master, iv, 0, RABBIT_SECTOR_SIZE, buf, BUFLEN, out1);
+	printf("Sectors of %d bytes: run time = %u\n\n", RABBIT_SECTOR_SIZE, time_stop());
+
+	// Authenticated encryption of the whole buffer, then its check
+	time_start();
+	rabbit_aead_seal(&master, iv, NULL, 0, buf, BUFLEN, out1, tag);
+	printf("AEAD seal: run time = %u\n", time_stop());
+
+	time_start();
+	if(rabbit_aead_open(&master, iv, NULL, 0, out1, BUFLEN, tag, out2))
+		printf("AEAD tag mismatch!\n");
+	printf("AEAD open: run time = %u\n\n", time_stop());
+
+	// Encryption with a CRC32C of the ciphertext: two passes and fused
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	time_start();
+	rabbit_crypt_stream(&ctx, buf, BUFLEN, out1);
+	crc = rabbit_crc32c(0, out1, BUFLEN);
+	printf("Crypt, then CRC32C: run time = %u\n", time_stop());
+
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	time_start();
+	if(rabbit_crypt_stream_crc32c(&ctx, buf, BUFLEN, out2, 0, 0) != crc)
+		printf("CRC32C mismatch!\n");
+	printf("Fused crypt and CRC32C: run time = %u\n\n", time_stop());
+
+	// Typed random draws
+	draws = xmalloc(sizeof(*draws) * DRAWS);
+	memset(draws, 0, sizeof(*draws) * DRAWS);
+	rabbit_rng_init(&rng, key, iv);
+
+	time_start();
+	rabbit_rng_double(&rng, draws, DRAWS);
+	printf("%d uniform doubles: run time = %u\n", DRAWS, time_stop());
+
+	time_start();
+	rabbit_rng_normal(&rng, draws, DRAWS, 0.0, 1.0);
+	printf("%d normal doubles: run time = %u\n\n", DRAWS, time_stop());
+
+	free(draws);
+
+	// MESSAGE-byte messages, one IV each: the library calls and the inline fast path
+	rabbit_key_setup(&master, key, 16);
+
+	time_start();
+	for(i = 0; i < MESSAGES; i++) {
+		memcpy(iv, &i, sizeof(i));
+		rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+		rabbit_crypt(&ctx, buf, MESSAGE, out1 + (i % BATCH) * MESSAGE);
+	}
+	printf("%d %d-byte messages, key and IV setup each: run time = %u\n", MESSAGES, MESSAGE, time_stop());
+
+	time_start();
+	for(i = 0; i < MESSAGES; i++) {
+		memcpy(iv, &i, sizeof(i));
+		rabbit_inline_set_key_and_iv(&ctx, key, iv);
+		rabbit_inline_crypt(&ctx, buf, MESSAGE, out2 + (i % BATCH) * MESSAGE);
+	}
+	printf("%d %d-byte messages, inline key and IV setup each: run time = %u\n", MESSAGES, MESSAGE, time_stop());
+
+	time_start();
+	for(i = 0; i < MESSAGES; i++) {
+		memcpy(iv, &i, sizeof(i));
+		rabbit_inline_crypt_master(&master, iv, buf, MESSAGE, out2 + (i % BATCH) * MESSAGE);
+	}
+	printf("%d %d-byte messages, inline from the master state: run time = %u\n\n", MESSAGES, MESSAGE, time_stop());
+
+	if(memcmp(out1, out2, BATCH * MESSAGE))
+		printf("Inline fast path mismatch!\n");
+
+	memset(iv, 'i', sizeof(iv));
+
+	// Packets of a header and a payload fragment: copied into one buffer and scatter-gather
+	memset(hdr, 'h', sizeof(hdr));
+	rabbit_set_key_and_iv(&ctx, (uint8_t *)key, 16, iv, 8);
+	time_start();
+	for(off = 0; off < BUFLEN; off += n) {
+		n = (BUFLEN - off < CHUNK) ? BUFLEN - off : CHUNK;
+		memcpy(pkt, hdr, HEADER);
+		memcpy(pkt + HEADER, buf + off, n);
+		rabbit_crypt_stream(&ctx, pkt, HEADER + n, pkt);
+	}
+	printf("%d-byte header and %d-byte payload, copied: run time = %u\n", HEADER, CHUNK, time_stop());
+
+	rabbit_set_key_and_iv(&ctx, (uint8_t *)key, 16, iv, 8);
+	time_start();
+	for(off = 0; off < BUFLEN; off += n) {
+		n = (BUFLEN - off < CHUNK) ? BUFLEN - off : CHUNK;
+		vin[0].iov_base = hdr;
+		vin[0].iov_len = HEADER;
+		vin[1].iov_base = buf + off;
+		vin[1].iov_len = n;
+		vout[0].iov_base = pkt;
+		vout[0].iov_len = HEADER + n;
+		rabbit_cryptv(&ctx, vin, 2, vout, 1);
+	}
+	printf("%d-byte header and %d-byte payload, scatter-gather: run time = %u\n\n", HEADER, CHUNK, time_stop());
+
+	// Stream of CHUNK-byte packets: inline and from the precomputed ring
+	rabbit_set_key_and_iv(&ctx, (uint8_t *)key, 16, iv, 8);
+	time_start();
+	for(off = 0; off < BUFLEN; off += n) {
+		n = (BUFLEN - off < CHUNK) ? BUFLEN - off : CHUNK;
+		rabbit_crypt_stream(&ctx, buf + off, n, out1 + off);
+	}
+	printf("Stream of %d-byte packets: run time = %u\n", CHUNK, time_stop());
+
+	rabbit_set_key_and_iv(&ctx, (uint8_t *)key, 16, iv, 8);
+	if((ring = rabbit_ring_new(&ctx, RING)) == NULL) {
+		printf("Ring allocation error!\n");
+		exit(1);
+	}
+
+	time_start();
+	for(off = 0; off < BUFLEN; off += n) {
+		n = (BUFLEN - off < CHUNK) ? BUFLEN - off : CHUNK;
+		rabbit_ring_crypt(ring, buf + off, n, out2 + off);
+	}
+	printf("Ring of %d KiB, %d-byte packets: run time = %u\n\n", RING / 1024, CHUNK, time_stop());
+
+	rabbit_ring_free(ring, NULL);
+	free(setup_ctx);
+	free(setup_key);
+	free(setup_iv);
+
 	return 0;
 }
 
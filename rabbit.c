@@ -15,46 +15,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_core.h"
 
 #define RABBIT	16
 
-#define ROTL32(v, n)	((v << n) | (v >> (32 - n)))
-
-// Selecting the byte order
-#if __BYTE_ORDER == __BIG_ENDIAN
-#define U32TO32(x)								\
-	((x << 24) | ((x << 8) & 0xFF0000) | ((x >> 8) & 0xFF00) | (x >> 24))
-#elif __BYTE_ORDER == __LITTLE_ENDIAN
-#define U32TO32(x)	(x)
-#else
-#error unsuported byte order
-#endif
-
-#define U8TO32_LITTLE(p) 					  \
-	(((uint32_t)((p)[0])      ) | ((uint32_t)((p)[1]) << 8) | \
-	 ((uint32_t)((p)[2]) << 16) | ((uint32_t)((p)[3]) << 24))
-
-// G-func the RABBIT-128 algorithm. The upper 32 bits XOR the lower 32 bits
-#define G_FUNC(x, y) {						  \
-	uint32_t a, b, h;					  \
-	a = x & 0xFFFF;						  \
-	b = x >> 16;					 	  \
-	h = ((((a*a) >> 17) + (a*b)) >> 15) + b*b;		  \
-	y = h ^ (x*x);						  \
-}
-
-// Constant of the algorithm for the function rabbit_next_state 
-#define A0	0x4D34D34D
-#define A1	0xD34D34D3
-#define A2	0x34D34D34
-#define A3	A0
-#define A4	A1
-#define A5	A2
-#define A6	A0
-#define A7	A1
-
 // Rabbit initialization function
 static void
 rabbit_init(struct rabbit_context *ctx)
@@ -62,127 +30,315 @@ rabbit_init(struct rabbit_context *ctx)
 	memset(ctx, 0, sizeof(*ctx));
 }
 
-// Calculate the next internal state
+// Setup secret key, key - 16 bytes, zero-padded
 static void
-rabbit_next_state(struct rabbit_context *ctx)
+rabbit_key_schedule(struct rabbit_context *ctx, const uint8_t *key)
 {
-	uint32_t g[8], c_old[8];
-	int i;
-
-	memcpy(c_old, ctx->c, sizeof(ctx->c));
-	
-	ctx->c[0] = ctx->c[0] + A0 + ctx->carry;
-	ctx->c[1] = ctx->c[1] + A1 + (ctx->c[0] < c_old[0]);
-	ctx->c[2] = ctx->c[2] + A2 + (ctx->c[1] < c_old[1]);
-	ctx->c[3] = ctx->c[3] + A3 + (ctx->c[2] < c_old[2]);
-	ctx->c[4] = ctx->c[4] + A4 + (ctx->c[3] < c_old[3]);
-	ctx->c[5] = ctx->c[5] + A5 + (ctx->c[4] < c_old[4]);
-	ctx->c[6] = ctx->c[6] + A6 + (ctx->c[5] < c_old[5]);
-	ctx->c[7] = ctx->c[7] + A7 + (ctx->c[6] < c_old[6]);
-	ctx->carry = (ctx->c[7] < c_old[7]);
-	
-	for(i = 0; i < 8; i++)
-		G_FUNC((ctx->x[i] + ctx->c[i]), g[i]);
-
-	ctx->x[0] = g[0] + ROTL32(g[7], 16) + ROTL32(g[6], 16);
-	ctx->x[1] = g[1] + ROTL32(g[0], 8) + g[7];
-	ctx->x[2] = g[2] + ROTL32(g[1], 16) + ROTL32(g[0], 16);
-	ctx->x[3] = g[3] + ROTL32(g[2], 8) + g[1];
-	ctx->x[4] = g[4] + ROTL32(g[3], 16) + ROTL32(g[2], 16);
-	ctx->x[5] = g[5] + ROTL32(g[4], 8) + g[3];
-	ctx->x[6] = g[6] + ROTL32(g[5], 16) + ROTL32(g[4], 16);
-	ctx->x[7] = g[7] + ROTL32(g[6], 8) + g[5];
+	rabbit_core_key_schedule(key, ctx->x, ctx->c, &ctx->carry);
 }
 
-// Setup secret key
+// Setup vector initialization, iv - 8 bytes, zero-padded
 static void
-rabbit_key_setup(struct rabbit_context *ctx)
+rabbit_iv_schedule(struct rabbit_context *ctx, const uint8_t *iv)
 {
-	uint32_t k0, k1, k2, k3;
-	int i;
+	rabbit_core_iv_schedule(iv, ctx->x, ctx->c, &ctx->carry);
+}
 
-	// Copy the secret key into 4 parts
-	k0 = U8TO32_LITTLE((ctx->key + 0));
-	k1 = U8TO32_LITTLE((ctx->key + 4));
-	k2 = U8TO32_LITTLE((ctx->key + 8));
-	k3 = U8TO32_LITTLE((ctx->key + 12));
+// Setup the key into the master state, the key itself is not kept
+// Return value: 0 (if all is well), -1 (if all bad) 
+int
+rabbit_key_setup(struct rabbit_master *master, const uint8_t *key, const int keylen)
+{
+	uint8_t k[RABBIT] = { 0 };
+
+	memset(master, 0, sizeof(*master));
 	
-	ctx->x[0] = k0;
-	ctx->x[2] = k1;
-	ctx->x[4] = k2;
-	ctx->x[6] = k3;
-	ctx->x[1] = (k3 << 16) | (k2 >> 16);
-	ctx->x[3] = (k0 << 16) | (k3 >> 16);
-	ctx->x[5] = (k1 << 16) | (k0 >> 16);
-	ctx->x[7] = (k2 << 16) | (k1 >> 16);
-
-	ctx->c[0] = (k2 << 16) | (k2 >> 16);
-	ctx->c[2] = (k3 << 16) | (k3 >> 16);
-	ctx->c[4] = (k0 << 16) | (k0 >> 16);
-	ctx->c[6] = (k1 << 16) | (k1 >> 16);
-	ctx->c[1] = (k0 >> 16) | (k1 << 16);
-	ctx->c[3] = (k1 >> 16) | (k2 << 16);
-	ctx->c[5] = (k2 >> 16) | (k3 << 16);
-	ctx->c[7] = (k3 >> 16) | (k0 << 16);
+	if((keylen <= 0) || (keylen > RABBIT))
+		return -1;
 	
-	ctx->carry = 0;
-
-	for(i = 0; i < 4; i++)
-		rabbit_next_state(ctx);	
+	memcpy(k, key, keylen);
 	
-	// (i+4) & 0x7 = (i+4) % 8
-	for(i = 0; i < 8; i++)
-		ctx->c[i] ^= ctx->x[(i+4) & 0x7];
+	rabbit_core_key_schedule(k, master->x, master->c, &master->carry);
+
+	rabbit_wipe(k, sizeof(k));
+
+	return 0;
 }
 
-// Setup vector initialization
-static void
-rabbit_iv_setup(struct rabbit_context *ctx)
+// Start the context from the master state with a new IV
+// Return value: 0 (if all is well), -1 (if all bad) 
+int
+rabbit_iv_setup(struct rabbit_context *ctx, const struct rabbit_master *master,
+	const uint8_t *iv, const int ivlen)
 {
-	uint32_t iv0, iv1, iv2, iv3;
-	int i;
+	uint8_t v[8] = { 0 };
+
+	if((ivlen <= 0) || (ivlen > 8))
+		return -1;
 	
-	iv0 = U8TO32_LITTLE((ctx->iv + 0));
-	iv1 = U8TO32_LITTLE((ctx->iv + 4));
-	iv2 = (iv1 & 0xffff0000) | (iv0 >> 16);
-	iv3 = (iv1 << 16) | (iv0 & 0x0000ffff);
-		
-	ctx->c[0] ^= iv0;
-	ctx->c[1] ^= iv2;
-	ctx->c[2] ^= iv1;
-	ctx->c[3] ^= iv3;
-	ctx->c[4] ^= iv0;
-	ctx->c[5] ^= iv2;
-	ctx->c[6] ^= iv1;
-	ctx->c[7] ^= iv3;
+	memcpy(v, iv, ivlen);
 	
-	for(i = 0; i < 4; i++)
-		rabbit_next_state(ctx);
+	rabbit_master_setup(ctx, master);
+	rabbit_iv_schedule(ctx, v);
+
+	return 0;
+}
+
+// Start the context from a master state without an IV
+void
+rabbit_master_setup(struct rabbit_context *ctx, const struct rabbit_master *master)
+{
+	rabbit_init(ctx);
+	rabbit_master_load(ctx, master);
 }
 
-// Fill the rabbit context (key and iv)
+void
+rabbit_context_wipe(struct rabbit_context *ctx)
+{
+	rabbit_wipe(ctx, sizeof(*ctx));
+}
+
+void
+rabbit_master_wipe(struct rabbit_master *master)
+{
+	rabbit_wipe(master, sizeof(*master));
+}
+
+// Fill the rabbit context (key and iv), the key schedule is not kept
 // Return value: 0 (if all is well), -1 (if all bad) 
 int
 rabbit_set_key_and_iv(struct rabbit_context *ctx, const uint8_t *key, const int keylen, const uint8_t iv[8], const int ivlen)
 {
+	struct rabbit_master master;
+	int ret;
+
 	rabbit_init(ctx);
-	
-	if((keylen > 0) && (keylen <= RABBIT))
-		ctx->keylen = keylen;
-	else
+
+	if((ivlen <= 0) || (ivlen > 8))
 		return -1;
 	
-	if((ivlen > 0) && (ivlen <= 8))
-		ctx->ivlen = ivlen;
-	else
+	if(rabbit_key_setup(&master, key, keylen))
 		return -1;
-	
-	memcpy(ctx->key, key, ctx->keylen);
-	memcpy(ctx->iv, iv, ctx->ivlen);
-	
-	// Setup key and vector initialization
-	rabbit_key_setup(ctx);
-	rabbit_iv_setup(ctx);
+
+	ret = rabbit_iv_setup(ctx, &master, iv, ivlen);
+	rabbit_wipe(&master, sizeof(master));
+
+	return ret;
+}
+
+static uint64_t llc;
+
+// Size of the last level cache, 8 MiB if the system does not tell
+static uint64_t
+rabbit_llc_size(void)
+{
+	long n;
+
+	if(llc == 0) {
+		n = sysconf(_SC_LEVEL3_CACHE_SIZE);
+		if(n <= 0)
+			n = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		llc = (n > 0) ? (uint64_t)n : 8 << 20;
+	}
+
+	return llc;
+}
+
+// Threshold of the tiled path for the tests, 0 asks the system again
+void
+rabbit_llc_set(uint64_t size)
+{
+	llc = size;
+}
+
+/* 
+ * Decoupled crypt: the keystream is generated into an L1-resident tile,
+ * then the tile is XORed into the data with the widest vectors of the
+ * backend. nt - use non-temporal stores for the output.
+*/
+static void
+rabbit_crypt_tiled(const struct rabbit_backend *b, struct rabbit_context *ctx,
+	const uint8_t *buf, size_t buflen, uint8_t *out, int nt)
+{
+	uint8_t tile[RABBIT_TILE] __attribute__((aligned(64)));
+	uint32_t len;
+
+	while(buflen >= 16) {
+		len = (buflen < RABBIT_TILE) ? (uint32_t)(buflen & ~15U) : RABBIT_TILE;
+
+		b->keystream(ctx, tile, len / 16);
+		b->xor_tile(out, buf, tile, len, nt);
+
+		buflen -= len, buf += len, out += len;
+	}
+
+	if(buflen)
+		b->crypt(ctx, buf, buflen, out);
+
+#if defined(__x86_64__) || defined(__i386__)
+	// Order the streaming stores before anything that follows
+	if(nt)
+		__builtin_ia32_sfence();
+#endif
+}
+
+/* 
+ * Bulk setup of n contexts with 16-byte keys and 8-byte IVs.
+ * ctx - array of n RABBIT contexts
+ * key - array of n keys
+ * iv - array of n IVs, or NULL for the key setup only
+ * Groups of contexts go through the SIMD lanes of the backend,
+ * the rest is set up one by one.
+*/
+void
+rabbit_setup_bulk(struct rabbit_context *ctx, const uint8_t (*key)[16], const uint8_t (*iv)[8], size_t n)
+{
+	const struct rabbit_backend *b = rabbit_backend_get();
+	struct rabbit_context *cp[16];
+	const uint8_t *kp[16], *ip[16];
+	size_t i;
+	int lane;
+
+	for(i = 0; i < n; i++)
+		rabbit_init(&ctx[i]);
+
+	i = 0;
+
+	if(b->lanes > 1) {
+		for(; i + b->lanes <= n; i += b->lanes) {
+			for(lane = 0; lane < b->lanes; lane++) {
+				cp[lane] = &ctx[i + lane];
+				kp[lane] = key[i + lane];
+				ip[lane] = (iv != NULL) ? iv[i + lane] : NULL;
+			}
+
+			b->setup_lanes(cp, kp, (iv != NULL) ? ip : NULL);
+		}
+	}
+
+	for(; i < n; i++) {
+		rabbit_key_schedule(&ctx[i], key[i]);
+		if(iv != NULL)
+			rabbit_iv_schedule(&ctx[i], iv[i]);
+	}
+}
+
+// Packets sorted in one pass of rabbit_crypt_packets
+#define PACKET_WINDOW	256
+
+struct rabbit_packet_ref {
+	uint32_t len;
+	uint32_t i;
+};
+
+// Longest packets first
+static int
+rabbit_packet_cmp(const void *a, const void *b)
+{
+	const struct rabbit_packet_ref *pa = a, *pb = b;
+
+	return (pa->len < pb->len) - (pa->len > pb->len);
+}
+
+/* 
+ * RABBIT crypt of n packets under one master state.
+ * The packets of a window are sorted by length, so the lanes of a
+ * group finish at about the same block. Every group of the backend
+ * lane count starts from the master state, the shortest packets left
+ * over go one by one.
+*/
+void
+rabbit_crypt_packets(const struct rabbit_master *master, const uint8_t (*iv)[8],
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out, size_t n)
+{
+	const struct rabbit_backend *b = rabbit_backend_get();
+	struct rabbit_packet_ref ref[PACKET_WINDOW];
+	struct rabbit_context tmp;
+	const uint8_t *ip[16], *bp[16];
+	uint32_t lp[16];
+	uint8_t *op[16];
+	size_t base, m, j, i;
+	int lane;
+
+	for(base = 0; base < n; base += m) {
+		m = (n - base < PACKET_WINDOW) ? n - base : PACKET_WINDOW;
+
+		for(j = 0; j < m; j++) {
+			ref[j].len = buflen[base + j];
+			ref[j].i = j;
+		}
+
+		j = 0;
+
+		if(b->lanes > 1 && m >= (size_t)b->lanes) {
+			qsort(ref, m, sizeof(ref[0]), rabbit_packet_cmp);
+
+			for(; j + b->lanes <= m; j += b->lanes) {
+				for(lane = 0; lane < b->lanes; lane++) {
+					i = base + ref[j + lane].i;
+					ip[lane] = iv[i];
+					bp[lane] = buf[i];
+					lp[lane] = buflen[i];
+					op[lane] = out[i];
+				}
+
+				b->packet_lanes(master, ip, bp, lp, op);
+			}
+		}
+
+		for(; j < m; j++) {
+			i = base + ref[j].i;
+			rabbit_master_load(&tmp, master);
+			rabbit_iv_schedule(&tmp, iv[i]);
+			rabbit_crypt(&tmp, buf[i], buflen[i], out[i]);
+		}
+	}
+
+	rabbit_wipe(&tmp, sizeof(tmp));
+}
+
+// Sectors per rabbit_crypt_packets call of rabbit_crypt_sectors
+#define SECTOR_WINDOW	64
+
+/* 
+ * RABBIT crypt of a run of sectors.
+ * The IV of a sector is the base IV read as a little-endian 64-bit
+ * number plus the sector number, modulo 2^64. The run goes through
+ * rabbit_crypt_packets, so contiguous sectors share the SIMD lanes.
+ * Return value: 0 (if all is well), -1 (zero sector size)
+*/
+int
+rabbit_crypt_sectors(const struct rabbit_master *master, const uint8_t base_iv[8], uint64_t sector,
+	uint32_t sector_size, const uint8_t *buf, size_t buflen, uint8_t *out)
+{
+	uint8_t iv[SECTOR_WINDOW][8];
+	const uint8_t *bp[SECTOR_WINDOW];
+	uint8_t *op[SECTOR_WINDOW];
+	uint32_t lp[SECTOR_WINDOW];
+	uint64_t base = 0, v;
+	size_t n;
+	int i, j;
+
+	if(sector_size == 0)
+		return -1;
+
+	for(i = 7; i >= 0; i--)
+		base = (base << 8) | base_iv[i];
+
+	while(buflen) {
+		for(n = 0; n < SECTOR_WINDOW && buflen; n++, sector++) {
+			v = base + sector;
+			for(j = 0; j < 8; j++)
+				iv[n][j] = v >> (8 * j);
+
+			lp[n] = (buflen < sector_size) ? buflen : sector_size;
+			bp[n] = buf;
+			op[n] = out;
+			buflen -= lp[n], buf += lp[n], out += lp[n];
+		}
+
+		rabbit_crypt_packets(master, (const uint8_t (*)[8])iv, bp, lp, op, n);
+	}
 
 	return 0;
 }
@@ -190,77 +346,296 @@ rabbit_set_key_and_iv(struct rabbit_context *ctx, const uint8_t *key, const int
 /* 
  * RABBIT crypt algorithm.
  * ctx - pointer on RABBIT context
- * buf - pointer on buffer data
+ * buf - pointer on buffer data, any alignment
  * buflen - length the data buffer
- * out - pointer on output array
+ * out - pointer on output array, any alignment, may be equal to buf
+ * The work is done by the backend selected at the first call.
+ * Buffers that fit in the last level cache go through the fused kernel
+ * of the backend. Larger ones take the decoupled path with streaming
+ * stores, so a multi-GB pass does not evict the rest of the cache;
+ * its XOR peels the head of out up to the vector alignment.
 */
 void
-rabbit_crypt(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+rabbit_crypt(struct rabbit_context *ctx, const uint8_t *buf, size_t buflen, uint8_t *out)
 {
-	uint32_t keystream[4];
-	uint32_t i;
-	
-	for(; buflen >= 16; buflen -= 16, buf += 16, out += 16) {
-		rabbit_next_state(ctx);
-
-		*(uint32_t *)(out +  0) = *(uint32_t *)(buf +  0) ^ U32TO32((ctx->x[0] ^
-			(ctx->x[5] >> 16) ^ (ctx->x[3] << 16)));
-		*(uint32_t *)(out +  4) = *(uint32_t *)(buf +  4) ^ U32TO32((ctx->x[2] ^
-			(ctx->x[7] >> 16) ^ (ctx->x[5] << 16)));
-		*(uint32_t *)(out +  8) = *(uint32_t *)(buf +  8) ^ U32TO32((ctx->x[4] ^
-			(ctx->x[1] >> 16) ^ (ctx->x[7] << 16)));
-		*(uint32_t *)(out + 12) = *(uint32_t *)(buf + 12) ^ U32TO32((ctx->x[6] ^ 
-			(ctx->x[3] >> 16) ^ (ctx->x[1] << 16)));
+	const struct rabbit_backend *b = rabbit_backend_get();
+
+	// The fused kernels take 32-bit lengths
+	if(buflen < rabbit_llc_size() && buflen <= UINT32_MAX)
+		b->crypt(ctx, buf, buflen, out);
+	else
+		rabbit_crypt_tiled(b, ctx, buf, buflen, out, 1);
+}
+
+/* 
+ * RABBIT crypt of a stream cut into chunks of any length.
+ * The leftover keystream goes first, the whole blocks go through
+ * rabbit_crypt, the last partial block is generated into the context.
+*/
+void
+rabbit_crypt_stream(struct rabbit_context *ctx, const uint8_t *buf, size_t buflen, uint8_t *out)
+{
+	const uint8_t *ks;
+	size_t n, i;
+
+	n = (buflen < ctx->nleft) ? buflen : ctx->nleft;
+	ks = ctx->leftover + 16 - ctx->nleft;
+
+	for(i = 0; i < n; i++)
+		out[i] = buf[i] ^ ks[i];
+
+	ctx->nleft -= n;
+	buflen -= n, buf += n, out += n;
+
+	n = buflen & ~(size_t)15;
+	if(n) {
+		rabbit_crypt(ctx, buf, n, out);
+		buflen -= n, buf += n, out += n;
 	}
-	
+
 	if(buflen) {
-		rabbit_next_state(ctx);
-		
-		keystream[0] = U32TO32((ctx->x[0] ^ (ctx->x[5] >> 16) ^ (ctx->x[3] << 16)));
-		keystream[1] = U32TO32((ctx->x[2] ^ (ctx->x[7] >> 16) ^ (ctx->x[5] << 16)));
-		keystream[2] = U32TO32((ctx->x[4] ^ (ctx->x[1] >> 16) ^ (ctx->x[7] << 16)));
-		keystream[3] = U32TO32((ctx->x[6] ^ (ctx->x[3] >> 16) ^ (ctx->x[1] << 16)));
+		rabbit_backend_get()->keystream(ctx, ctx->leftover, 1);
 
 		for(i = 0; i < buflen; i++)
-			out[i] = buf[i] ^ ((uint8_t *)keystream)[i];	
+			out[i] = buf[i] ^ ctx->leftover[i];
+
+		ctx->nleft = 16 - buflen;
 	}
 }
 
-#if __BYTE_ORDER == __BIG_ENDIAN
+/* 
+ * RABBIT crypt of a scatter-gather stream.
+ * The two arrays are walked together, every piece (the overlap of the
+ * current input and output fragments) goes through rabbit_crypt_stream,
+ * so the keystream goes on across the fragment edges and the whole
+ * blocks inside a piece take the wide kernel.
+ * Return value: 0 (if all is well), -1 (the output is shorter)
+*/
+int
+rabbit_cryptv(struct rabbit_context *ctx, const struct iovec *in, int incnt,
+	const struct iovec *out, int outcnt)
+{
+	size_t inlen = 0, outlen = 0, inoff = 0, outoff = 0, n;
+	int i, o;
+
+	for(i = 0; i < incnt; i++)
+		inlen += in[i].iov_len;
+	for(o = 0; o < outcnt; o++)
+		outlen += out[o].iov_len;
+
+	if(outlen < inlen)
+		return -1;
+
+	for(i = 0, o = 0; i < incnt; ) {
+		if(inoff == in[i].iov_len) {
+			i++, inoff = 0;
+			continue;
+		}
+		if(outoff == out[o].iov_len) {
+			o++, outoff = 0;
+			continue;
+		}
+
+		n = in[i].iov_len - inoff;
+		if(n > out[o].iov_len - outoff)
+			n = out[o].iov_len - outoff;
+
+		rabbit_crypt_stream(ctx, (const uint8_t *)in[i].iov_base + inoff, n,
+			(uint8_t *)out[o].iov_base + outoff);
+
+		inoff += n, outoff += n;
+	}
+
+	return 0;
+}
+
+/* 
+ * Raw keystream, the output of rabbit_crypt on zeros without the XOR.
+ * A 16-byte aligned out takes the whole blocks straight from the
+ * backend, an unaligned one goes through an L1 tile. The rest of
+ * the last block is dropped, as in rabbit_crypt.
+*/
+void
+rabbit_keystream(struct rabbit_context *ctx, uint8_t *out, size_t len)
+{
+	const struct rabbit_backend *b = rabbit_backend_get();
+	uint8_t tile[RABBIT_TILE] __attribute__((aligned(64)));
+	size_t n;
+
+	if(((uintptr_t)out & 15) == 0) {
+		for(; len >= 16; len -= n, out += n) {
+			n = (len < ((size_t)1 << 30)) ? len & ~(size_t)15 : (size_t)1 << 30;
+			b->keystream(ctx, out, n / 16);
+		}
+	}
+
+	for(; len; len -= n, out += n) {
+		n = (len < RABBIT_TILE) ? len : RABBIT_TILE;
+		b->keystream(ctx, tile, (n + 15) / 16);
+		memcpy(out, tile, n);
+	}
+
+	rabbit_wipe(tile, sizeof(tile));
+}
+
+/* 
+ * Fast-forward: advance the stream by nblocks keystream blocks
+ * (16 bytes each) without generating them. The leftover keystream
+ * of rabbit_crypt_stream is dropped, the stream goes on at a block
+ * boundary.
+*/
+void
+rabbit_skip(struct rabbit_context *ctx, uint64_t nblocks)
+{
+	rabbit_backend_get()->skip(ctx, nblocks);
+	ctx->nleft = 0;
+}
+
+// Little-endian word of the snapshot
+static void
+rabbit_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/* 
+ * Serialize the working state.
+ * Layout, all words little-endian:
+ *  0  magic "RBS" and the version byte
+ *  4  x[8]
+ * 36  c[8]
+ * 68  carry
+ * 72  nleft
+ * 76  leftover[16]
+*/
+void
+rabbit_snapshot(const struct rabbit_context *ctx, uint8_t out[RABBIT_SNAPSHOT_SIZE])
+{
+	int i;
+
+	out[0] = 'R';
+	out[1] = 'B';
+	out[2] = 'S';
+	out[3] = RABBIT_SNAPSHOT_VERSION;
+
+	for(i = 0; i < 8; i++) {
+		rabbit_put32(out + 4 + 4*i, ctx->x[i]);
+		rabbit_put32(out + 36 + 4*i, ctx->c[i]);
+	}
+
+	rabbit_put32(out + 68, ctx->carry);
+	rabbit_put32(out + 72, ctx->nleft);
+	memcpy(out + 76, ctx->leftover, 16);
+}
+
+// Load a snapshot into the working state
+// Return value: 0 (if all is well), -1 (not a snapshot, unknown version, corrupted)
+int
+rabbit_restore(struct rabbit_context *ctx, const uint8_t in[RABBIT_SNAPSHOT_SIZE])
+{
+	uint32_t carry, nleft;
+	int i;
+
+	if(in[0] != 'R' || in[1] != 'B' || in[2] != 'S' || in[3] != RABBIT_SNAPSHOT_VERSION)
+		return -1;
+
+	carry = RABBIT_U8TO32_LITTLE((in + 68));
+	nleft = RABBIT_U8TO32_LITTLE((in + 72));
+
+	if(carry > 1 || nleft > 16)
+		return -1;
+
+	for(i = 0; i < 8; i++) {
+		ctx->x[i] = RABBIT_U8TO32_LITTLE((in + 4 + 4*i));
+		ctx->c[i] = RABBIT_U8TO32_LITTLE((in + 36 + 4*i));
+	}
+
+	ctx->carry = carry;
+	ctx->nleft = nleft;
+	memcpy(ctx->leftover, in + 76, 16);
+
+	return 0;
+}
+
+// Portable backend
+void
+rabbit_crypt_scalar(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	rabbit_core_crypt(ctx, buf, buflen, out);
+}
+
+void
+rabbit_keystream_scalar(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks)
+{
+	rabbit_core_keystream(ctx, ks, nblocks);
+}
+
+void
+rabbit_skip_scalar(struct rabbit_context *ctx, uint64_t nblocks)
+{
+	rabbit_core_skip(ctx, nblocks);
+}
+
+void
+rabbit_xor_scalar(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt)
+{
+	// Plain stores, the scalar XOR has no streaming form
+	(void)nt;
+	rabbit_core_xor(out, buf, ks, len);
+}
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 #define PRINT_U32TO32(x) \
 	(printf("%02x %02x %02x %02x ", (x >> 24), ((x >> 16) & 0xFF), ((x >> 8) & 0xFF), (x & 0xFF)))
-#elif __BYTE_ORDER == __LITTLE_ENDIAN
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
 #define PRINT_U32TO32(x) \
 	(printf("%02x %02x %02x %02x ", (x & 0xFF), ((x >> 8) & 0xFF), ((x >> 16) & 0xFF), (x >> 24)))
 #else
 #error unsupported byte order
 #endif
 
-// Test vectors print
+// Test vectors print: the first keystream block of the context
 void
 rabbit_test_vectors(struct rabbit_context *ctx)
+{
+	rabbit_test_vectors_key(ctx, NULL, NULL);
+}
+
+/*
+ * Key and IV are printed when given: the context does not keep them
+ * since the key schedule left it.
+*/
+void
+rabbit_test_vectors_key(struct rabbit_context *ctx, const uint8_t key[16], const uint8_t iv[8])
 {
 	uint32_t keystream[4];
 	int i;
 
 	rabbit_next_state(ctx);
 	
-	keystream[0] = U32TO32((ctx->x[0] ^ (ctx->x[5] >> 16) ^ (ctx->x[3] << 16)));
-	keystream[1] = U32TO32((ctx->x[2] ^ (ctx->x[7] >> 16) ^ (ctx->x[5] << 16)));
-	keystream[2] = U32TO32((ctx->x[4] ^ (ctx->x[1] >> 16) ^ (ctx->x[7] << 16)));
-	keystream[3] = U32TO32((ctx->x[6] ^ (ctx->x[3] >> 16) ^ (ctx->x[1] << 16)));
+	keystream[0] = RABBIT_U32TO32((ctx->x[0] ^ (ctx->x[5] >> 16) ^ (ctx->x[3] << 16)));
+	keystream[1] = RABBIT_U32TO32((ctx->x[2] ^ (ctx->x[7] >> 16) ^ (ctx->x[5] << 16)));
+	keystream[2] = RABBIT_U32TO32((ctx->x[4] ^ (ctx->x[1] >> 16) ^ (ctx->x[7] << 16)));
+	keystream[3] = RABBIT_U32TO32((ctx->x[6] ^ (ctx->x[3] >> 16) ^ (ctx->x[1] << 16)));
 
 	printf("\n Test vectors for the Rabbit:\n");
 
-	printf("\nKey:       ");
+	if(key) {
+		printf("\nKey:       ");
 
-	for(i = 0; i < 16; i++)
-		printf("%02x ", ctx->key[i]);
+		for(i = 0; i < 16; i++)
+			printf("%02x ", key[i]);
+	}
 	
-	printf("\nIV:        ");
+	if(iv) {
+		printf("\nIV:        ");
 
-	for(i = 0; i < 8; i++)
-		printf("%02x ", ctx->iv[i]);
+		for(i = 0; i < 8; i++)
+			printf("%02x ", iv[i]);
+	}
 	
 	printf("\nKeystream: ");
 	
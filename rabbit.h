@@ -8,30 +8,196 @@
 #ifndef RABBIT_H
 #define RABBIT_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The functions never throw, C++ callers need no unwind path around the calls
+#ifdef __GNUC__
+#define RABBIT_NOTHROW	__attribute__((nothrow))
+#else
+#define RABBIT_NOTHROW
+#endif
+
 /* 
- * RABBIT-128 context
- * keylen - chiper key length in bytes
- * ivlen - vector initializaton length in bytes
- * key - chiper key
- * iv - initialization vector
+ * RABBIT-128 master state, the state right after the key setup.
+ * It is as secret as the key: keep it apart from the working contexts
+ * and clear it with rabbit_master_wipe once the key is retired.
+ * x - the state variables
+ * c - the counter system
+ * carry - 513 bit, the internal state
+*/
+struct rabbit_master {
+	uint32_t x[8];
+	uint32_t c[8];
+	uint32_t carry;
+};
+
+/* 
+ * RABBIT-128 context, aligned on a cache line.
+ * The key and the IV are not kept after the setup.
  * x - the state variables
  * c - the counter system  
  * carry - 513 bit, the internal state
+ * nleft - the unused bytes at the end of leftover
+ * leftover - the last keystream block of rabbit_crypt_stream
+ * x and c fill the first cache line, carry and the stream fields the
+ * second one: 88 bytes, 128 with the alignment.
 */
 struct rabbit_context {
-	int keylen;
-	int ivlen;
-	uint8_t key[16];
-	uint8_t iv[8];
 	uint32_t x[8];
 	uint32_t c[8];
 	uint32_t carry;
-};
+	uint32_t nleft;
+	uint8_t leftover[16] __attribute__((aligned(16)));
+} __attribute__((aligned(64)));
+
+RABBIT_NOTHROW int rabbit_set_key_and_iv(struct rabbit_context *ctx, const uint8_t *key, const int keylen, const uint8_t iv[8], const int ivlen);
+
+/* 
+ * Key schedule once per key into a master state. rabbit_iv_setup then
+ * starts a context from it with a new IV, as many times as needed.
+*/
+RABBIT_NOTHROW int rabbit_key_setup(struct rabbit_master *master, const uint8_t *key, const int keylen);
+
+RABBIT_NOTHROW int rabbit_iv_setup(struct rabbit_context *ctx, const struct rabbit_master *master,
+	const uint8_t *iv, const int ivlen);
+
+/* 
+ * Start the context from a master state without an IV, as if
+ * rabbit_set_key_and_iv took the key alone. rabbit_constexpr.hpp
+ * computes master states of fixed keys at compile time.
+*/
+RABBIT_NOTHROW void rabbit_master_setup(struct rabbit_context *ctx, const struct rabbit_master *master);
+
+// Clear a context or a master state, the stores are not optimized away
+RABBIT_NOTHROW void rabbit_context_wipe(struct rabbit_context *ctx);
+
+RABBIT_NOTHROW void rabbit_master_wipe(struct rabbit_master *master);
+
+/* 
+ * Bulk setup of n contexts with 16-byte keys and 8-byte IVs
+ * (iv may be NULL), done in the SIMD lanes of the backend.
+*/
+RABBIT_NOTHROW void rabbit_setup_bulk(struct rabbit_context *ctx, const uint8_t (*key)[16], const uint8_t (*iv)[8], size_t n);
+
+/* 
+ * One-key, many-IV crypt of n packets, e.g. datagrams with a per-packet
+ * IV: packet i is crypted as by rabbit_iv_setup(master, iv[i]) and
+ * rabbit_crypt, the key schedule is done once. The IV setups and the
+ * packets run in the SIMD lanes of the backend.
+*/
+RABBIT_NOTHROW void rabbit_crypt_packets(const struct rabbit_master *master, const uint8_t (*iv)[8],
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out, size_t n);
+
+/* 
+ * Sector mode for random-access storage: every sector is a packet of
+ * rabbit_crypt_packets with the IV base_iv + sector number (little-endian,
+ * modulo 2^64), so any sector is crypted without the ones before it.
+ * buf holds the sectors from sector on, the last one may be short.
+ * Return value: 0, or -1 if sector_size is zero.
+*/
+#define RABBIT_SECTOR_SIZE	4096
 
-int rabbit_set_key_and_iv(struct rabbit_context *ctx, const uint8_t *key, const int keylen, const uint8_t iv[8], const int ivlen);
+RABBIT_NOTHROW int rabbit_crypt_sectors(const struct rabbit_master *master, const uint8_t base_iv[8], uint64_t sector,
+	uint32_t sector_size, const uint8_t *buf, size_t buflen, uint8_t *out);
 
-void rabbit_crypt(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+/* 
+ * Block-oriented crypt: every call starts on a new keystream block,
+ * the rest of the last block of a call is dropped.
+ * buf and out may have any alignment and any 64-bit length.
+ * In place (buf == out) is supported, other overlaps are not.
+*/
+RABBIT_NOTHROW void rabbit_crypt(struct rabbit_context *ctx, const uint8_t *buf, size_t buflen, uint8_t *out);
+
+/* 
+ * Stream crypt: the unused keystream of a call is kept in the context
+ * and consumed first by the next call, so the output does not depend
+ * on the chunk sizes. buf may be equal to out.
+ * Do not mix it with rabbit_crypt on the same stream.
+*/
+RABBIT_NOTHROW void rabbit_crypt_stream(struct rabbit_context *ctx, const uint8_t *buf, size_t buflen, uint8_t *out);
+
+/* 
+ * Scatter-gather stream crypt: the input fragments are crypted as one
+ * stream, as by rabbit_crypt_stream on their concatenation, into the
+ * output fragments. The two arrays may be cut differently, the output
+ * must hold at least the input bytes; in == out is supported. No copy
+ * to a linear buffer is made.
+ * Return value: 0, or -1 if the output is shorter (nothing is crypted).
+*/
+RABBIT_NOTHROW int rabbit_cryptv(struct rabbit_context *ctx, const struct iovec *in, int incnt,
+	const struct iovec *out, int outcnt);
+
+/* 
+ * Raw keystream: the output of rabbit_crypt on a buffer of zeros,
+ * with the same block rules, without reading any input.
+*/
+RABBIT_NOTHROW void rabbit_keystream(struct rabbit_context *ctx, uint8_t *out, size_t len);
+
+/* 
+ * Fast-forward the stream by nblocks 16-byte keystream blocks,
+ * only the state update is done. A partial block left by
+ * rabbit_crypt_stream is dropped.
+*/
+RABBIT_NOTHROW void rabbit_skip(struct rabbit_context *ctx, uint64_t nblocks);
+
+/* 
+ * Versioned snapshot of the working state (x, c, carry and the
+ * leftover of rabbit_crypt_stream), in a fixed little-endian layout
+ * that can be stored and loaded on another host. The key and the
+ * master state are not in it. rabbit_restore overwrites the working
+ * state only and returns -1 on a bad or unknown snapshot.
+*/
+#define RABBIT_SNAPSHOT_VERSION	1
+#define RABBIT_SNAPSHOT_SIZE	92
 
-void rabbit_test_vectors(struct rabbit_context *ctx);
+RABBIT_NOTHROW void rabbit_snapshot(const struct rabbit_context *ctx, uint8_t out[RABBIT_SNAPSHOT_SIZE]);
+
+RABBIT_NOTHROW int rabbit_restore(struct rabbit_context *ctx, const uint8_t in[RABBIT_SNAPSHOT_SIZE]);
+
+/* 
+ * Multi-stream crypt: eight different contexts in one call (AVX2).
+ * The lengths may differ, the lanes out of whole blocks run on a
+ * scratch buffer until the longest one is done.
+ * Must only be called on a CPU with AVX2.
+*/
+RABBIT_NOTHROW void rabbit_crypt_x8(struct rabbit_context *ctx[8], const uint8_t *buf[8], const uint32_t buflen[8], uint8_t *out[8]);
+
+/* 
+ * Multi-stream crypt: sixteen different contexts in one call (AVX-512).
+ * The lengths may differ, short lanes are masked off instead of
+ * falling back to the scalar code.
+ * Must only be called on a CPU with AVX-512F/BW/VL.
+*/
+RABBIT_NOTHROW void rabbit_crypt_x16(struct rabbit_context *ctx[16], const uint8_t *buf[16], const uint32_t buflen[16], uint8_t *out[16]);
+
+/* 
+ * Backend of rabbit_crypt: scalar, sse2, avx2 or avx512.
+ * It is chosen at the first use from CPUID, the RABBIT_BACKEND
+ * environment variable can force a name, "auto" or "bench"
+ * (time the supported backends and take the fastest one).
+*/
+RABBIT_NOTHROW const char *rabbit_backend(void);
+
+RABBIT_NOTHROW int rabbit_backend_select(const char *name);
+
+RABBIT_NOTHROW void rabbit_test_vectors(struct rabbit_context *ctx);
+
+// rabbit_test_vectors with the key and the IV of the context printed
+RABBIT_NOTHROW void rabbit_test_vectors_key(struct rabbit_context *ctx, const uint8_t key[16], const uint8_t iv[8]);
+
+#ifdef __cplusplus
+}
+#endif
+
+// Header-only fast path of the small messages, see rabbit_inline.h
+#ifdef RABBIT_INLINE
+#include "rabbit_inline.h"
+#endif
 
 #endif
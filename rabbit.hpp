@@ -0,0 +1,310 @@
+/*
+ * C++20 interface of the RABBIT-128 library.
+ * rabbit::stream owns a rabbit_context and rabbit::master the key
+ * schedule of a key: both are move-only, a move copies the state and
+ * wipes the source, the destructor wipes the state. The
+ * data goes in std::span<const std::byte> and out std::span<std::byte>.
+ * Every method is an inline noexcept call of the C function, there is
+ * no virtual dispatch and no allocation, so the code is the same as the
+ * C calls plus the wipe. The batch paths are templates over the batch
+ * size, their pointer arrays are built on the stack.
+ *
+ *	rabbit::stream s(key, iv);
+ *	s.crypt(in, out);
+ *
+ * With rabbit_constexpr.hpp, the key schedule of a fixed key is done
+ * at compile time: rabbit::stream s(rabbit::key_schedule(key), iv).
+*/
+
+#ifndef RABBIT_HPP
+#define RABBIT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <sys/uio.h>
+
+#include "rabbit.h"
+
+namespace rabbit {
+
+using key_type = std::array<std::byte, 16>;
+using iv_type = std::array<std::byte, 8>;
+
+using key_span = std::span<const std::byte, 16>;
+using iv_span = std::span<const std::byte, 8>;
+
+namespace detail {
+
+inline const uint8_t *
+u8(const std::byte *p) noexcept
+{
+	return reinterpret_cast<const uint8_t *>(p);
+}
+
+inline uint8_t *
+u8(std::byte *p) noexcept
+{
+	return reinterpret_cast<uint8_t *>(p);
+}
+
+// Clear a state, the stores are not optimized away
+template <typename T>
+inline void
+wipe(T &state) noexcept
+{
+	std::memset(&state, 0, sizeof(state));
+	__asm__ __volatile__("" : : "r"(&state) : "memory");
+}
+
+}
+
+/*
+ * Key schedule of one key (rabbit_key_setup), for the streams of that
+ * key (stream(master, iv), iv()) and the batch calls. It converts to
+ * the C master state, so rabbit::key_schedule results go in the same
+ * places.
+*/
+class master {
+public:
+	explicit master(key_span key) noexcept
+	{
+		rabbit_key_setup(&m_, detail::u8(key.data()), 16);
+	}
+
+	master(const master &) = delete;
+	master &operator=(const master &) = delete;
+
+	master(master &&other) noexcept : m_(other.m_)
+	{
+		detail::wipe(other.m_);
+	}
+
+	master &
+	operator=(master &&other) noexcept
+	{
+		if(this != &other) {
+			m_ = other.m_;
+			detail::wipe(other.m_);
+		}
+
+		return *this;
+	}
+
+	~master()
+	{
+		detail::wipe(m_);
+	}
+
+	const struct rabbit_master &
+	native() const noexcept
+	{
+		return m_;
+	}
+
+	operator const struct rabbit_master &() const noexcept
+	{
+		return m_;
+	}
+
+private:
+	struct rabbit_master m_;
+};
+
+static_assert(!std::is_copy_constructible_v<master>, "master must be move-only");
+
+/*
+ * One RABBIT-128 stream.
+ * The output spans must be at least as long as the input ones, in and
+ * out may be the same span (the in-place overloads take one span).
+*/
+class stream {
+public:
+	// Zero state without a key, to be assigned a keyed stream
+	stream() noexcept : ctx_{} {}
+
+	stream(key_span key, iv_span iv) noexcept
+	{
+		rabbit_set_key_and_iv(&ctx_, detail::u8(key.data()), 16, detail::u8(iv.data()), 8);
+	}
+
+	// From a master state computed beforehand: rabbit::master or rabbit::key_schedule
+	explicit stream(const struct rabbit_master &master) noexcept
+	{
+		rabbit_master_setup(&ctx_, &master);
+	}
+
+	stream(const struct rabbit_master &master, iv_span iv) noexcept
+	{
+		rabbit_iv_setup(&ctx_, &master, detail::u8(iv.data()), 8);
+	}
+
+	stream(const stream &) = delete;
+	stream &operator=(const stream &) = delete;
+
+	stream(stream &&other) noexcept : ctx_(other.ctx_)
+	{
+		other.wipe();
+	}
+
+	stream &
+	operator=(stream &&other) noexcept
+	{
+		if(this != &other) {
+			ctx_ = other.ctx_;
+			other.wipe();
+		}
+
+		return *this;
+	}
+
+	~stream()
+	{
+		wipe();
+	}
+
+	// Restart from the key schedule with a new IV
+	void
+	iv(const struct rabbit_master &master, iv_span iv) noexcept
+	{
+		rabbit_iv_setup(&ctx_, &master, detail::u8(iv.data()), 8);
+	}
+
+	// rabbit_crypt: every call starts on a new keystream block
+	void
+	crypt(std::span<const std::byte> in, std::span<std::byte> out) noexcept
+	{
+		rabbit_crypt(&ctx_, detail::u8(in.data()), in.size(), detail::u8(out.data()));
+	}
+
+	void
+	crypt(std::span<std::byte> buf) noexcept
+	{
+		rabbit_crypt(&ctx_, detail::u8(buf.data()), buf.size(), detail::u8(buf.data()));
+	}
+
+	// rabbit_crypt_stream: the output does not depend on the chunk sizes
+	void
+	crypt_stream(std::span<const std::byte> in, std::span<std::byte> out) noexcept
+	{
+		rabbit_crypt_stream(&ctx_, detail::u8(in.data()), in.size(), detail::u8(out.data()));
+	}
+
+	void
+	crypt_stream(std::span<std::byte> buf) noexcept
+	{
+		rabbit_crypt_stream(&ctx_, detail::u8(buf.data()), buf.size(), detail::u8(buf.data()));
+	}
+
+	// rabbit_cryptv, false if the output is shorter than the input
+	bool
+	cryptv(std::span<const struct iovec> in, std::span<const struct iovec> out) noexcept
+	{
+		return rabbit_cryptv(&ctx_, in.data(), (int)in.size(), out.data(), (int)out.size()) == 0;
+	}
+
+	void
+	keystream(std::span<std::byte> out) noexcept
+	{
+		rabbit_keystream(&ctx_, detail::u8(out.data()), out.size());
+	}
+
+	void
+	skip(uint64_t nblocks) noexcept
+	{
+		rabbit_skip(&ctx_, nblocks);
+	}
+
+	// Clear the state, the stores are not optimized away
+	void
+	wipe() noexcept
+	{
+		detail::wipe(ctx_);
+	}
+
+	// The C context, for the rest of the C API
+	struct rabbit_context *
+	native() noexcept
+	{
+		return &ctx_;
+	}
+
+	const struct rabbit_context *
+	native() const noexcept
+	{
+		return &ctx_;
+	}
+
+private:
+	struct rabbit_context ctx_;
+};
+
+// An array of streams is an array of contexts for the bulk C calls
+static_assert(std::is_standard_layout_v<stream>, "stream must wrap the context only");
+static_assert(sizeof(stream) == sizeof(struct rabbit_context), "stream must wrap the context only");
+static_assert(!std::is_copy_constructible_v<stream>, "stream must be move-only");
+static_assert(std::is_nothrow_move_constructible_v<stream>, "stream moves must not throw");
+static_assert(sizeof(key_type) == 16 && sizeof(iv_type) == 8, "key and IV arrays must be packed");
+
+/*
+ * rabbit_setup_bulk: key and IV setup of the streams in the SIMD lanes.
+ * key and iv hold one entry per stream.
+*/
+inline void
+setup_bulk(std::span<stream> s, std::span<const key_type> key, std::span<const iv_type> iv) noexcept
+{
+	rabbit_setup_bulk(reinterpret_cast<struct rabbit_context *>(s.data()),
+		reinterpret_cast<const uint8_t (*)[16]>(key.data()),
+		reinterpret_cast<const uint8_t (*)[8]>(iv.data()), s.size());
+}
+
+template <std::size_t N>
+inline void
+setup_bulk(std::array<stream, N> &s, const std::array<key_type, N> &key, const std::array<iv_type, N> &iv) noexcept
+{
+	setup_bulk(std::span<stream>(s), std::span<const key_type>(key), std::span<const iv_type>(iv));
+}
+
+/*
+ * rabbit_crypt_packets: N packets under the key schedule m, one IV
+ * each. A packet is at most 4 GiB - 1.
+*/
+template <std::size_t N>
+inline void
+crypt_packets(const struct rabbit_master &m, const std::array<iv_type, N> &iv,
+	const std::array<std::span<const std::byte>, N> &in, const std::array<std::span<std::byte>, N> &out) noexcept
+{
+	const uint8_t *buf[N];
+	uint32_t buflen[N];
+	uint8_t *dst[N];
+
+	for(std::size_t i = 0; i < N; i++) {
+		buf[i] = detail::u8(in[i].data());
+		buflen[i] = (uint32_t)in[i].size();
+		dst[i] = detail::u8(out[i].data());
+	}
+
+	rabbit_crypt_packets(&m, reinterpret_cast<const uint8_t (*)[8]>(iv.data()), buf, buflen, dst, N);
+}
+
+/*
+ * rabbit_crypt_sectors: the sectors of in from sector on, under the key
+ * schedule m and the IVs base_iv + sector number.
+*/
+template <uint32_t SectorSize = RABBIT_SECTOR_SIZE>
+inline void
+crypt_sectors(const struct rabbit_master &m, iv_span base_iv, uint64_t sector,
+	std::span<const std::byte> in, std::span<std::byte> out) noexcept
+{
+	static_assert(SectorSize > 0, "the sector size must be positive");
+
+	rabbit_crypt_sectors(&m, detail::u8(base_iv.data()), sector, SectorSize,
+		detail::u8(in.data()), in.size(), detail::u8(out.data()));
+}
+
+}
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * RABBIT-128 + Poly1305 authenticated encryption of the RABBIT-128 library.
+ * Rabbit blocks are 16 bytes, so the Poly1305 key takes the first two
+ * keystream blocks and the data starts at the third one. Poly1305 is
+ * computed in radix 2^44 with 64x64->128 bit products.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_core.h"
+#include "rabbit_aead.h"
+
+#define MASK44	0xfffffffffffULL
+#define MASK42	0x3ffffffffffULL
+
+typedef unsigned __int128 u128;
+
+/*
+ * Poly1305 state.
+ * r - the clamped key, h - the accumulator, both in three 44/44/42-bit limbs
+ * pad - the second half of the key, added at the end
+ * block, nblock - a partial block of the input
+*/
+struct poly1305 {
+	uint64_t r[3];
+	uint64_t h[3];
+	uint64_t pad[2];
+	uint8_t block[16];
+	uint32_t nblock;
+};
+
+static inline uint64_t
+get64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline void
+put64(uint8_t *p, uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	memcpy(p, &v, 8);
+}
+
+static void
+poly1305_init(struct poly1305 *st, const uint8_t key[32])
+{
+	uint64_t t0, t1;
+
+	t0 = get64(key);
+	t1 = get64(key + 8);
+
+	st->r[0] = t0 & 0xffc0fffffffULL;
+	st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+	st->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+	st->h[0] = st->h[1] = st->h[2] = 0;
+
+	st->pad[0] = get64(key + 16);
+	st->pad[1] = get64(key + 24);
+
+	st->nblock = 0;
+}
+
+// h = (h + m) * r for every 16-byte block, hibit is 2^128 in the top limb
+static void
+poly1305_blocks(struct poly1305 *st, const uint8_t *m, size_t len, uint64_t hibit)
+{
+	uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+	uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+	uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+	uint64_t t0, t1, c;
+	u128 d0, d1, d2;
+
+	for(; len >= 16; len -= 16, m += 16) {
+		t0 = get64(m);
+		t1 = get64(m + 8);
+
+		h0 += t0 & MASK44;
+		h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+		h2 += ((t1 >> 24) & MASK42) | hibit;
+
+		d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+		d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+		d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+		c = (uint64_t)(d0 >> 44);
+		h0 = (uint64_t)d0 & MASK44;
+		d1 += c;
+		c = (uint64_t)(d1 >> 44);
+		h1 = (uint64_t)d1 & MASK44;
+		d2 += c;
+		c = (uint64_t)(d2 >> 42);
+		h2 = (uint64_t)d2 & MASK42;
+		h0 += c * 5;
+		c = h0 >> 44;
+		h0 &= MASK44;
+		h1 += c;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+}
+
+static void
+poly1305_update(struct poly1305 *st, const uint8_t *m, size_t len)
+{
+	size_t n;
+
+	if(st->nblock) {
+		n = 16 - st->nblock;
+		if(n > len)
+			n = len;
+		memcpy(st->block + st->nblock, m, n);
+		st->nblock += n;
+		m += n, len -= n;
+
+		if(st->nblock < 16)
+			return;
+
+		poly1305_blocks(st, st->block, 16, 1ULL << 40);
+		st->nblock = 0;
+	}
+
+	n = len & ~(size_t)15;
+	if(n) {
+		poly1305_blocks(st, m, n, 1ULL << 40);
+		m += n, len -= n;
+	}
+
+	if(len) {
+		memcpy(st->block, m, len);
+		st->nblock = len;
+	}
+}
+
+// Zeros up to the next 16-byte boundary of the input
+static void
+poly1305_pad16(struct poly1305 *st)
+{
+	static const uint8_t zero[16];
+
+	if(st->nblock)
+		poly1305_update(st, zero, 16 - st->nblock);
+}
+
+static void
+poly1305_finish(struct poly1305 *st, uint8_t tag[16])
+{
+	uint64_t h0, h1, h2, g0, g1, g2, c, t0, t1;
+
+	// The last partial block ends with a 1 byte, no 2^128 bit
+	if(st->nblock) {
+		st->block[st->nblock] = 1;
+		memset(st->block + st->nblock + 1, 0, 15 - st->nblock);
+		poly1305_blocks(st, st->block, 16, 0);
+	}
+
+	h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+
+	c = h1 >> 44; h1 &= MASK44; h2 += c;
+	c = h2 >> 42; h2 &= MASK42; h0 += c * 5;
+	c = h0 >> 44; h0 &= MASK44; h1 += c;
+	c = h1 >> 44; h1 &= MASK44; h2 += c;
+	c = h2 >> 42; h2 &= MASK42; h0 += c * 5;
+	c = h0 >> 44; h0 &= MASK44; h1 += c;
+
+	// g = h + 5 - 2^130, taken instead of h if it does not go negative
+	g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+	g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+	g2 = h2 + c - (1ULL << 42);
+
+	c = (g2 >> 63) - 1;
+	h0 = (h0 & ~c) | (g0 & c);
+	h1 = (h1 & ~c) | (g1 & c);
+	h2 = (h2 & ~c) | (g2 & c);
+
+	// h + pad mod 2^128
+	t0 = st->pad[0];
+	t1 = st->pad[1];
+
+	h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+	h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+	h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+
+	put64(tag, h0 | (h1 << 44));
+	put64(tag + 8, (h1 >> 20) | (h2 << 24));
+
+	rabbit_wipe(st, sizeof(*st));
+}
+
+// One-shot Poly1305, for the test vectors
+void
+rabbit_poly1305(uint8_t tag[16], const uint8_t key[32], const uint8_t *m, size_t len)
+{
+	struct poly1305 st;
+
+	poly1305_init(&st, key);
+	poly1305_update(&st, m, len);
+	poly1305_finish(&st, tag);
+}
+
+// The context of the message and the Poly1305 key from its first two blocks
+static void
+aead_start(struct rabbit_context *tmp, struct poly1305 *mac, const struct rabbit_backend *b,
+	const struct rabbit_master *master, const uint8_t iv[8], const uint8_t *aad, size_t aadlen)
+{
+	uint8_t pk[32] __attribute__((aligned(64)));
+
+	rabbit_master_load(tmp, master);
+	rabbit_core_iv_schedule(iv, tmp->x, tmp->c, &tmp->carry);
+
+	b->keystream(tmp, pk, 2);
+	poly1305_init(mac, pk);
+	rabbit_wipe(pk, sizeof(pk));
+
+	if(aadlen) {
+		poly1305_update(mac, aad, aadlen);
+		poly1305_pad16(mac);
+	}
+}
+
+// The lengths block and the tag
+static void
+aead_finish(struct poly1305 *mac, size_t aadlen, size_t buflen, uint8_t tag[16])
+{
+	uint8_t len[16];
+
+	poly1305_pad16(mac);
+	put64(len, aadlen);
+	put64(len + 8, buflen);
+	poly1305_update(mac, len, 16);
+	poly1305_finish(mac, tag);
+}
+
+/*
+ * The fused pass: keystream of a tile, XOR, and Poly1305 over the
+ * ciphertext of the tile while it is in L1. seal selects the side of
+ * the XOR the ciphertext is on.
+*/
+static void
+aead_crypt(struct rabbit_context *tmp, struct poly1305 *mac, const struct rabbit_backend *b,
+	const uint8_t *buf, size_t buflen, uint8_t *out, int seal)
+{
+	uint8_t tile[RABBIT_TILE] __attribute__((aligned(64)));
+	uint32_t len;
+
+	while(buflen) {
+		len = (buflen < RABBIT_TILE) ? (uint32_t)buflen : RABBIT_TILE;
+
+		b->keystream(tmp, tile, (len + 15) / 16);
+
+		if(seal) {
+			b->xor_tile(out, buf, tile, len, 0);
+			poly1305_update(mac, out, len);
+		} else {
+			poly1305_update(mac, buf, len);
+			b->xor_tile(out, buf, tile, len, 0);
+		}
+
+		buflen -= len, buf += len, out += len;
+	}
+
+	rabbit_wipe(tile, sizeof(tile));
+}
+
+void
+rabbit_aead_seal(const struct rabbit_master *master, const uint8_t iv[8],
+	const uint8_t *aad, size_t aadlen, const uint8_t *buf, size_t buflen,
+	uint8_t *out, uint8_t tag[RABBIT_AEAD_TAG_SIZE])
+{
+	const struct rabbit_backend *b = rabbit_backend_get();
+	struct rabbit_context tmp;
+	struct poly1305 mac;
+
+	aead_start(&tmp, &mac, b, master, iv, aad, aadlen);
+	aead_crypt(&tmp, &mac, b, buf, buflen, out, 1);
+	aead_finish(&mac, aadlen, buflen, tag);
+
+	rabbit_wipe(&tmp, sizeof(tmp));
+}
+
+int
+rabbit_aead_open(const struct rabbit_master *master, const uint8_t iv[8],
+	const uint8_t *aad, size_t aadlen, const uint8_t *buf, size_t buflen,
+	const uint8_t tag[RABBIT_AEAD_TAG_SIZE], uint8_t *out)
+{
+	const struct rabbit_backend *b = rabbit_backend_get();
+	struct rabbit_context tmp;
+	struct poly1305 mac;
+	uint8_t t[RABBIT_AEAD_TAG_SIZE], diff = 0;
+	int i;
+
+	aead_start(&tmp, &mac, b, master, iv, aad, aadlen);
+	aead_crypt(&tmp, &mac, b, buf, buflen, out, 0);
+	aead_finish(&mac, aadlen, buflen, t);
+
+	rabbit_wipe(&tmp, sizeof(tmp));
+
+	for(i = 0; i < RABBIT_AEAD_TAG_SIZE; i++)
+		diff |= t[i] ^ tag[i];
+
+	if(diff) {
+		rabbit_wipe(out, buflen);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * RABBIT-128 + Poly1305 authenticated encryption of the RABBIT-128 library.
+ * The construction follows ChaCha20-Poly1305 (RFC 8439): the one-time
+ * Poly1305 key is the first 32 bytes of the keystream of (key, iv), the
+ * data is crypted with the keystream that follows, and the tag covers
+ * aad || pad16 || ciphertext || pad16 || le64(aadlen) || le64(buflen).
+ * Every tile is crypted and authenticated while it is in L1, so the
+ * payload is read from memory once.
+ * An IV must never be used twice under the same key.
+*/
+
+#ifndef RABBIT_AEAD_H
+#define RABBIT_AEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rabbit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RABBIT_AEAD_TAG_SIZE	16
+
+/*
+ * Encrypt buf into out and compute the tag.
+ * master - master state of rabbit_key_setup, not changed
+ * iv - the 8-byte IV of this message
+ * aad - additional data, authenticated but not encrypted (may be NULL if aadlen is 0)
+ * buf may be equal to out.
+*/
+void rabbit_aead_seal(const struct rabbit_master *master, const uint8_t iv[8],
+	const uint8_t *aad, size_t aadlen, const uint8_t *buf, size_t buflen,
+	uint8_t *out, uint8_t tag[RABBIT_AEAD_TAG_SIZE]);
+
+/*
+ * Check the tag and decrypt buf into out, same arguments as rabbit_aead_seal.
+ * The tag is compared in constant time.
+ * Return value: 0 (if all is well), -1 (bad tag, out is zeroed)
+*/
+int rabbit_aead_open(const struct rabbit_master *master, const uint8_t iv[8],
+	const uint8_t *aad, size_t aadlen, const uint8_t *buf, size_t buflen,
+	const uint8_t tag[RABBIT_AEAD_TAG_SIZE], uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
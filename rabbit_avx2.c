@@ -0,0 +1,571 @@
+/*
+ * AVX2 multi-stream kernel of the RABBIT-128 algorithm.
+ * Eight independent contexts are kept in the transposed layout
+ * (struct rabbit_x8), every 256-bit register holds one state word
+ * of all eight contexts. The file is compiled with -mavx2.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_core.h"
+
+#define ROTL32_X8(v, n)	\
+	_mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n))
+
+// Transpose eight contexts into the lane-per-context layout
+static void
+rabbit_x8_load(struct rabbit_x8 *st, struct rabbit_context *ctx[8])
+{
+	int i, lane;
+
+	for(lane = 0; lane < 8; lane++) {
+		for(i = 0; i < 8; i++) {
+			st->x[i][lane] = ctx[lane]->x[i];
+			st->c[i][lane] = ctx[lane]->c[i];
+		}
+		st->carry[lane] = ctx[lane]->carry;
+	}
+}
+
+// Write one lane back into its context
+static void
+rabbit_x8_store_lane(const struct rabbit_x8 *st, int lane, struct rabbit_context *ctx)
+{
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		ctx->x[i] = st->x[i][lane];
+		ctx->c[i] = st->c[i][lane];
+	}
+	ctx->carry = st->carry[lane];
+}
+
+// Write the lanes back into eight contexts
+static void
+rabbit_x8_store(const struct rabbit_x8 *st, struct rabbit_context *ctx[8])
+{
+	int lane;
+
+	for(lane = 0; lane < 8; lane++)
+		rabbit_x8_store_lane(st, lane, ctx[lane]);
+}
+
+// G-func for eight lanes: the 64-bit squares come from two vpmuludq
+static inline __m256i
+rabbit_x8_g_func(__m256i u)
+{
+	__m256i even, odd;
+
+	even = _mm256_mul_epu32(u, u);
+	odd = _mm256_srli_epi64(u, 32);
+	odd = _mm256_mul_epu32(odd, odd);
+
+	even = _mm256_xor_si256(even, _mm256_srli_epi64(even, 32));
+	odd = _mm256_xor_si256(odd, _mm256_slli_epi64(odd, 32));
+
+	return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+// Calculate the next internal state of eight lanes
+static inline void
+rabbit_x8_next_state(__m256i x[8], __m256i c[8], __m256i *carry)
+{
+	const uint32_t a[8] = { RABBIT_A0, RABBIT_A1, RABBIT_A2, RABBIT_A3,
+		RABBIT_A4, RABBIT_A5, RABBIT_A6, RABBIT_A7 };
+	const __m256i bias = _mm256_set1_epi32(0x80000000);
+	__m256i g[8], c_old;
+	int i;
+
+	// The counter carry chain, unsigned compare through the sign bias
+	for(i = 0; i < 8; i++) {
+		c_old = c[i];
+		c[i] = _mm256_add_epi32(_mm256_add_epi32(c[i], _mm256_set1_epi32(a[i])), *carry);
+		*carry = _mm256_srli_epi32(_mm256_cmpgt_epi32(_mm256_xor_si256(c_old, bias),
+			_mm256_xor_si256(c[i], bias)), 31);
+	}
+
+	for(i = 0; i < 8; i++)
+		g[i] = rabbit_x8_g_func(_mm256_add_epi32(x[i], c[i]));
+
+	x[0] = _mm256_add_epi32(g[0], _mm256_add_epi32(ROTL32_X8(g[7], 16), ROTL32_X8(g[6], 16)));
+	x[1] = _mm256_add_epi32(g[1], _mm256_add_epi32(ROTL32_X8(g[0], 8), g[7]));
+	x[2] = _mm256_add_epi32(g[2], _mm256_add_epi32(ROTL32_X8(g[1], 16), ROTL32_X8(g[0], 16)));
+	x[3] = _mm256_add_epi32(g[3], _mm256_add_epi32(ROTL32_X8(g[2], 8), g[1]));
+	x[4] = _mm256_add_epi32(g[4], _mm256_add_epi32(ROTL32_X8(g[3], 16), ROTL32_X8(g[2], 16)));
+	x[5] = _mm256_add_epi32(g[5], _mm256_add_epi32(ROTL32_X8(g[4], 8), g[3]));
+	x[6] = _mm256_add_epi32(g[6], _mm256_add_epi32(ROTL32_X8(g[5], 16), ROTL32_X8(g[4], 16)));
+	x[7] = _mm256_add_epi32(g[7], _mm256_add_epi32(ROTL32_X8(g[6], 8), g[5]));
+}
+
+// XOR 16 bytes of lanes lo and hi (the two halves of v) into the data
+static inline void
+rabbit_x8_xor_block(__m256i v, const uint8_t *buf_lo, const uint8_t *buf_hi,
+	uint8_t *out_lo, uint8_t *out_hi)
+{
+	__m256i in;
+
+	in = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)buf_lo));
+	in = _mm256_inserti128_si256(in, _mm_loadu_si128((const __m128i *)buf_hi), 1);
+	v = _mm256_xor_si256(v, in);
+
+	_mm_storeu_si128((__m128i *)out_lo, _mm256_castsi256_si128(v));
+	_mm_storeu_si128((__m128i *)out_hi, _mm256_extracti128_si256(v, 1));
+}
+
+/*
+ * Encrypt nblocks 16-byte blocks in every lane.
+ * st - the transposed state of eight contexts
+ * buf, out - input and output of every lane
+*/
+void
+rabbit_x8_crypt_blocks(struct rabbit_x8 *st, const uint8_t *buf[8], uint8_t *out[8], uint32_t nblocks)
+{
+	__m256i x[8], c[8], carry, s0, s1, s2, s3, t0, t1, t2, t3;
+	uint32_t n, off;
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		x[i] = _mm256_load_si256((const __m256i *)st->x[i]);
+		c[i] = _mm256_load_si256((const __m256i *)st->c[i]);
+	}
+	carry = _mm256_load_si256((const __m256i *)st->carry);
+
+	for(n = 0, off = 0; n < nblocks; n++, off += 16) {
+		rabbit_x8_next_state(x, c, &carry);
+
+		// Keystream words 0..3 of all lanes
+		s0 = _mm256_xor_si256(x[0], _mm256_xor_si256(_mm256_srli_epi32(x[5], 16), _mm256_slli_epi32(x[3], 16)));
+		s1 = _mm256_xor_si256(x[2], _mm256_xor_si256(_mm256_srli_epi32(x[7], 16), _mm256_slli_epi32(x[5], 16)));
+		s2 = _mm256_xor_si256(x[4], _mm256_xor_si256(_mm256_srli_epi32(x[1], 16), _mm256_slli_epi32(x[7], 16)));
+		s3 = _mm256_xor_si256(x[6], _mm256_xor_si256(_mm256_srli_epi32(x[3], 16), _mm256_slli_epi32(x[1], 16)));
+
+		// 4x4 transpose in both 128-bit halves: lanes i and i+4 per register
+		t0 = _mm256_unpacklo_epi32(s0, s1);
+		t1 = _mm256_unpackhi_epi32(s0, s1);
+		t2 = _mm256_unpacklo_epi32(s2, s3);
+		t3 = _mm256_unpackhi_epi32(s2, s3);
+
+		rabbit_x8_xor_block(_mm256_unpacklo_epi64(t0, t2), buf[0] + off, buf[4] + off, out[0] + off, out[4] + off);
+		rabbit_x8_xor_block(_mm256_unpackhi_epi64(t0, t2), buf[1] + off, buf[5] + off, out[1] + off, out[5] + off);
+		rabbit_x8_xor_block(_mm256_unpacklo_epi64(t1, t3), buf[2] + off, buf[6] + off, out[2] + off, out[6] + off);
+		rabbit_x8_xor_block(_mm256_unpackhi_epi64(t1, t3), buf[3] + off, buf[7] + off, out[3] + off, out[7] + off);
+	}
+
+	for(i = 0; i < 8; i++) {
+		_mm256_store_si256((__m256i *)st->x[i], x[i]);
+		_mm256_store_si256((__m256i *)st->c[i], c[i]);
+	}
+	_mm256_store_si256((__m256i *)st->carry, carry);
+}
+
+/*
+ * Key setup of eight lanes at once, the same steps as rabbit_key_setup.
+ * key - eight 16-byte keys
+*/
+void
+rabbit_x8_key_setup(struct rabbit_x8 *st, const uint8_t *key[8])
+{
+	uint32_t kw[4][8] __attribute__((aligned(32)));
+	__m256i x[8], c[8], carry, k0, k1, k2, k3;
+	int i, lane;
+
+	for(lane = 0; lane < 8; lane++)
+		for(i = 0; i < 4; i++)
+			kw[i][lane] = RABBIT_U8TO32_LITTLE((key[lane] + 4*i));
+
+	k0 = _mm256_load_si256((const __m256i *)kw[0]);
+	k1 = _mm256_load_si256((const __m256i *)kw[1]);
+	k2 = _mm256_load_si256((const __m256i *)kw[2]);
+	k3 = _mm256_load_si256((const __m256i *)kw[3]);
+
+	x[0] = k0;
+	x[2] = k1;
+	x[4] = k2;
+	x[6] = k3;
+	x[1] = _mm256_or_si256(_mm256_slli_epi32(k3, 16), _mm256_srli_epi32(k2, 16));
+	x[3] = _mm256_or_si256(_mm256_slli_epi32(k0, 16), _mm256_srli_epi32(k3, 16));
+	x[5] = _mm256_or_si256(_mm256_slli_epi32(k1, 16), _mm256_srli_epi32(k0, 16));
+	x[7] = _mm256_or_si256(_mm256_slli_epi32(k2, 16), _mm256_srli_epi32(k1, 16));
+
+	c[0] = ROTL32_X8(k2, 16);
+	c[2] = ROTL32_X8(k3, 16);
+	c[4] = ROTL32_X8(k0, 16);
+	c[6] = ROTL32_X8(k1, 16);
+	// High halves from the first key word, low halves from the second
+	c[1] = _mm256_blend_epi16(k1, k0, 0xAA);
+	c[3] = _mm256_blend_epi16(k2, k1, 0xAA);
+	c[5] = _mm256_blend_epi16(k3, k2, 0xAA);
+	c[7] = _mm256_blend_epi16(k0, k3, 0xAA);
+
+	carry = _mm256_setzero_si256();
+
+	for(i = 0; i < 4; i++)
+		rabbit_x8_next_state(x, c, &carry);
+
+	for(i = 0; i < 8; i++)
+		c[i] = _mm256_xor_si256(c[i], x[(i+4) & 0x7]);
+
+	for(i = 0; i < 8; i++) {
+		_mm256_store_si256((__m256i *)st->x[i], x[i]);
+		_mm256_store_si256((__m256i *)st->c[i], c[i]);
+	}
+	_mm256_store_si256((__m256i *)st->carry, carry);
+}
+
+/*
+ * IV setup of eight lanes at once, the same steps as rabbit_iv_setup.
+ * st - lanes after the key setup
+ * iv - eight 8-byte IVs
+*/
+void
+rabbit_x8_iv_setup(struct rabbit_x8 *st, const uint8_t *iv[8])
+{
+	uint32_t ivw[2][8] __attribute__((aligned(32)));
+	__m256i x[8], c[8], carry, iv0, iv1, iv2, iv3;
+	int i, lane;
+
+	for(i = 0; i < 8; i++) {
+		x[i] = _mm256_load_si256((const __m256i *)st->x[i]);
+		c[i] = _mm256_load_si256((const __m256i *)st->c[i]);
+	}
+	carry = _mm256_load_si256((const __m256i *)st->carry);
+
+	for(lane = 0; lane < 8; lane++) {
+		ivw[0][lane] = RABBIT_U8TO32_LITTLE((iv[lane] + 0));
+		ivw[1][lane] = RABBIT_U8TO32_LITTLE((iv[lane] + 4));
+	}
+
+	iv0 = _mm256_load_si256((const __m256i *)ivw[0]);
+	iv1 = _mm256_load_si256((const __m256i *)ivw[1]);
+	iv2 = _mm256_or_si256(_mm256_and_si256(iv1, _mm256_set1_epi32(0xffff0000)), _mm256_srli_epi32(iv0, 16));
+	iv3 = _mm256_or_si256(_mm256_slli_epi32(iv1, 16), _mm256_and_si256(iv0, _mm256_set1_epi32(0x0000ffff)));
+
+	c[0] = _mm256_xor_si256(c[0], iv0);
+	c[1] = _mm256_xor_si256(c[1], iv2);
+	c[2] = _mm256_xor_si256(c[2], iv1);
+	c[3] = _mm256_xor_si256(c[3], iv3);
+	c[4] = _mm256_xor_si256(c[4], iv0);
+	c[5] = _mm256_xor_si256(c[5], iv2);
+	c[6] = _mm256_xor_si256(c[6], iv1);
+	c[7] = _mm256_xor_si256(c[7], iv3);
+
+	for(i = 0; i < 4; i++)
+		rabbit_x8_next_state(x, c, &carry);
+
+	for(i = 0; i < 8; i++) {
+		_mm256_store_si256((__m256i *)st->x[i], x[i]);
+		_mm256_store_si256((__m256i *)st->c[i], c[i]);
+	}
+	_mm256_store_si256((__m256i *)st->carry, carry);
+}
+
+// Bulk setup backend: eight contexts per call
+void
+rabbit_setup_x8(struct rabbit_context **ctx, const uint8_t **key, const uint8_t **iv)
+{
+	struct rabbit_x8 st;
+
+	rabbit_x8_key_setup(&st, key);
+	if(iv != NULL)
+		rabbit_x8_iv_setup(&st, iv);
+	rabbit_x8_store(&st, ctx);
+	rabbit_wipe(&st, sizeof(st));
+}
+
+/*
+ * Packet backend: eight IV setups from one master state, then the crypt.
+ * The blocks common to all packets run in the AVX2 kernel, the lanes
+ * are then written to scratch contexts that finish the longer packets.
+*/
+void
+rabbit_packets_x8(const struct rabbit_master *master, const uint8_t **iv,
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out)
+{
+	struct rabbit_x8 st;
+	struct rabbit_context tmp[8], *tp[8];
+	uint32_t nblocks, done;
+	int i, lane;
+
+	for(i = 0; i < 8; i++) {
+		_mm256_store_si256((__m256i *)st.x[i], _mm256_set1_epi32(master->x[i]));
+		_mm256_store_si256((__m256i *)st.c[i], _mm256_set1_epi32(master->c[i]));
+	}
+	_mm256_store_si256((__m256i *)st.carry, _mm256_set1_epi32(master->carry));
+
+	rabbit_x8_iv_setup(&st, iv);
+
+	nblocks = buflen[0];
+	for(lane = 1; lane < 8; lane++)
+		if(buflen[lane] < nblocks)
+			nblocks = buflen[lane];
+	nblocks /= 16;
+
+	if(nblocks)
+		rabbit_x8_crypt_blocks(&st, buf, out, nblocks);
+
+	done = nblocks * 16;
+	for(lane = 0; lane < 8; lane++)
+		tp[lane] = &tmp[lane];
+	rabbit_x8_store(&st, tp);
+
+	for(lane = 0; lane < 8; lane++)
+		if(buflen[lane] > done)
+			rabbit_crypt(tp[lane], buf[lane] + done, buflen[lane] - done, out[lane] + done);
+}
+
+// With free lanes a kernel run is cut to the scratch size
+#define X8_SCRATCH_BLOCKS	64
+
+/*
+ * Crypt of eight lanes of different lengths, their states in st.
+ * The kernel runs until the longest lane has no whole block left: a
+ * lane that has none is written back to ctx and then reads and writes
+ * a scratch buffer, as in rabbit_mb.c. The last partial block of every
+ * lane goes through rabbit_crypt on ctx.
+*/
+static void
+rabbit_x8_crypt_masked(struct rabbit_x8 *st, struct rabbit_context *ctx[8],
+	const uint8_t *buf[8], const uint32_t buflen[8], uint8_t *out[8])
+{
+	uint8_t scratch[X8_SCRATCH_BLOCKS * 16] __attribute__((aligned(32)));
+	const uint8_t *bp[8];
+	uint8_t *op[8];
+	uint32_t done, n;
+	int lane, active = 0, used = 0;
+
+	for(lane = 0; lane < 8; lane++) {
+		if(buflen[lane] >= 16)
+			active |= 1 << lane;
+		else
+			rabbit_x8_store_lane(st, lane, ctx[lane]);
+	}
+
+	for(done = 0; active; done += n) {
+		n = UINT32_MAX;
+		for(lane = 0; lane < 8; lane++)
+			if((active >> lane & 1) && buflen[lane] / 16 - done < n)
+				n = buflen[lane] / 16 - done;
+		if(active != 0xFF && n > X8_SCRATCH_BLOCKS)
+			n = X8_SCRATCH_BLOCKS;
+
+		for(lane = 0; lane < 8; lane++) {
+			if(active >> lane & 1) {
+				bp[lane] = buf[lane] + (size_t)done * 16;
+				op[lane] = out[lane] + (size_t)done * 16;
+			} else {
+				bp[lane] = scratch;
+				op[lane] = scratch;
+				used = 1;
+			}
+		}
+
+		rabbit_x8_crypt_blocks(st, bp, op, n);
+
+		for(lane = 0; lane < 8; lane++)
+			if((active >> lane & 1) && buflen[lane] / 16 == done + n) {
+				rabbit_x8_store_lane(st, lane, ctx[lane]);
+				active &= ~(1 << lane);
+			}
+	}
+
+	for(lane = 0; lane < 8; lane++)
+		if(buflen[lane] & 15)
+			rabbit_crypt(ctx[lane], buf[lane] + (buflen[lane] & ~15U), buflen[lane] & 15,
+				out[lane] + (buflen[lane] & ~15U));
+
+	// The scratch holds keystream
+	if(used)
+		rabbit_wipe(scratch, sizeof(scratch));
+}
+
+/*
+ * RABBIT crypt of eight independent streams.
+ * ctx - eight pointers on different RABBIT contexts
+ * buf - eight pointers on data buffers
+ * buflen - eight lengths of the data buffers
+ * out - eight pointers on output arrays
+ * The lengths may differ: the AVX2 kernel runs until every lane is
+ * out of whole blocks, see rabbit_x8_crypt_masked.
+*/
+void
+rabbit_crypt_x8(struct rabbit_context *ctx[8], const uint8_t *buf[8], const uint32_t buflen[8], uint8_t *out[8])
+{
+	struct rabbit_x8 st;
+
+	rabbit_x8_load(&st, ctx);
+	rabbit_x8_crypt_masked(&st, ctx, buf, buflen, out);
+}
+
+/*
+ * Single-stream kernel: one context, x[8] and c[8] in one register each.
+ * The counter carry chain is resolved with a carry-lookahead on the
+ * lane masks: a lane generates a carry (G) if c + a wrapped around and
+ * propagates one (P) if c + a is all ones, then the carry into every
+ * lane is ((G << 1 | carry) + P) ^ P, bit 8 being the new carry bit.
+*/
+
+// Calculate the next internal state of one context
+static inline void
+rabbit_avx2_next_state(__m256i *x, __m256i *c, uint32_t *carry)
+{
+	const __m256i a = _mm256_setr_epi32(RABBIT_A0, RABBIT_A1, RABBIT_A2, RABBIT_A3,
+		RABBIT_A4, RABBIT_A5, RABBIT_A6, RABBIT_A7);
+	const __m256i bias = _mm256_set1_epi32(0x80000000);
+	const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	// g[i-1] and g[i-2] moved into lane i
+	const __m256i prev1 = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+	const __m256i prev2 = _mm256_setr_epi32(6, 7, 0, 1, 2, 3, 4, 5);
+	// Byte rotations: rotl 16 in the even lanes, rotl 8 or none in the odd lanes
+	const __m256i rot1 = _mm256_setr_epi8(2, 3, 0, 1, 7, 4, 5, 6, 10, 11, 8, 9, 15, 12, 13, 14,
+		2, 3, 0, 1, 7, 4, 5, 6, 10, 11, 8, 9, 15, 12, 13, 14);
+	const __m256i rot2 = _mm256_setr_epi8(2, 3, 0, 1, 4, 5, 6, 7, 10, 11, 8, 9, 12, 13, 14, 15,
+		2, 3, 0, 1, 4, 5, 6, 7, 10, 11, 8, 9, 12, 13, 14, 15);
+	__m256i s, cin, g;
+	uint32_t gen, prop, t;
+
+	s = _mm256_add_epi32(*c, a);
+	gen = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(
+		_mm256_xor_si256(*c, bias), _mm256_xor_si256(s, bias))));
+	prop = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(s,
+		_mm256_set1_epi32(-1))));
+
+	t = (((gen << 1) | *carry) + prop) ^ prop;
+	*carry = t >> 8;
+
+	// Lanes with a carry in get -1 from the compare, subtracting adds one
+	cin = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(t), bits), bits);
+	*c = _mm256_sub_epi32(s, cin);
+
+	g = rabbit_x8_g_func(_mm256_add_epi32(*x, *c));
+
+	*x = _mm256_add_epi32(g, _mm256_add_epi32(
+		_mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(g, prev1), rot1),
+		_mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(g, prev2), rot2)));
+}
+
+// Keystream block of one context in the low 128 bits
+static inline __m128i
+rabbit_avx2_keystream(__m256i x)
+{
+	const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	const __m256i hi = _mm256_setr_epi32(5, 7, 1, 3, 5, 7, 1, 3);
+	const __m256i lo = _mm256_setr_epi32(3, 5, 7, 1, 3, 5, 7, 1);
+	__m256i s;
+
+	s = _mm256_xor_si256(_mm256_permutevar8x32_epi32(x, even),
+		_mm256_srli_epi32(_mm256_permutevar8x32_epi32(x, hi), 16));
+	s = _mm256_xor_si256(s, _mm256_slli_epi32(_mm256_permutevar8x32_epi32(x, lo), 16));
+
+	return _mm256_castsi256_si128(s);
+}
+
+// Single-stream backend: the state stays in two registers for the whole call
+void
+rabbit_crypt_avx2(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	__m256i x, c;
+	__m128i ks;
+	uint8_t tail[16];
+	uint32_t carry, i;
+
+	x = _mm256_loadu_si256((const __m256i *)ctx->x);
+	c = _mm256_loadu_si256((const __m256i *)ctx->c);
+	carry = ctx->carry;
+
+	for(; buflen >= 16; buflen -= 16, buf += 16, out += 16) {
+		rabbit_avx2_next_state(&x, &c, &carry);
+
+		ks = rabbit_avx2_keystream(x);
+		_mm_storeu_si128((__m128i *)out, _mm_xor_si128(ks, _mm_loadu_si128((const __m128i *)buf)));
+	}
+
+	if(buflen) {
+		rabbit_avx2_next_state(&x, &c, &carry);
+
+		_mm_storeu_si128((__m128i *)tail, rabbit_avx2_keystream(x));
+		for(i = 0; i < buflen; i++)
+			out[i] = buf[i] ^ tail[i];
+	}
+
+	_mm256_storeu_si256((__m256i *)ctx->x, x);
+	_mm256_storeu_si256((__m256i *)ctx->c, c);
+	ctx->carry = carry;
+}
+
+// Keystream generation without the data
+void
+rabbit_keystream_avx2(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks)
+{
+	__m256i x, c;
+	uint32_t carry;
+
+	x = _mm256_loadu_si256((const __m256i *)ctx->x);
+	c = _mm256_loadu_si256((const __m256i *)ctx->c);
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--, ks += 16) {
+		rabbit_avx2_next_state(&x, &c, &carry);
+		_mm_store_si128((__m128i *)ks, rabbit_avx2_keystream(x));
+	}
+
+	_mm256_storeu_si256((__m256i *)ctx->x, x);
+	_mm256_storeu_si256((__m256i *)ctx->c, c);
+	ctx->carry = carry;
+}
+
+// Advance the state without the keystream output
+void
+rabbit_skip_avx2(struct rabbit_context *ctx, uint64_t nblocks)
+{
+	__m256i x, c;
+	uint32_t carry;
+
+	x = _mm256_loadu_si256((const __m256i *)ctx->x);
+	c = _mm256_loadu_si256((const __m256i *)ctx->c);
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--)
+		rabbit_avx2_next_state(&x, &c, &carry);
+
+	_mm256_storeu_si256((__m256i *)ctx->x, x);
+	_mm256_storeu_si256((__m256i *)ctx->c, c);
+	ctx->carry = carry;
+}
+
+/*
+ * XOR a keystream tile into the data with 256-bit loads.
+ * The head is peeled up to the 32-byte alignment of out, then the
+ * stores are aligned. With nt they bypass the caches.
+*/
+void
+rabbit_xor_avx2(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt)
+{
+	__m256i v;
+	uint32_t head;
+
+	head = (32 - ((uintptr_t)out & 31)) & 31;
+	if(head > len)
+		head = len;
+	rabbit_core_xor(out, buf, ks, head);
+	out += head, buf += head, ks += head, len -= head;
+
+	if(nt) {
+		for(; len >= 32; len -= 32, buf += 32, ks += 32, out += 32) {
+			v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)buf), _mm256_loadu_si256((const __m256i *)ks));
+			_mm256_stream_si256((__m256i *)out, v);
+		}
+	}
+
+	for(; len >= 32; len -= 32, buf += 32, ks += 32, out += 32) {
+		v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)buf), _mm256_loadu_si256((const __m256i *)ks));
+		_mm256_store_si256((__m256i *)out, v);
+	}
+
+	rabbit_core_xor(out, buf, ks, len);
+}
@@ -0,0 +1,546 @@
+/*
+ * AVX-512 multi-stream kernel of the RABBIT-128 algorithm.
+ * Sixteen independent contexts are kept in the transposed layout
+ * (struct rabbit_x16), every 512-bit register holds one state word
+ * of all sixteen contexts. Lanes that run out of data are switched
+ * off with mask registers, and the tails shorter than 16 bytes go
+ * through masked loads and stores, so no lane needs a scalar pass.
+ * The file is compiled with -mavx512f -mavx512bw -mavx512vl.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_core.h"
+
+// Transpose sixteen contexts into the lane-per-context layout
+static void
+rabbit_x16_load(struct rabbit_x16 *st, struct rabbit_context *ctx[16])
+{
+	int i, lane;
+
+	for(lane = 0; lane < 16; lane++) {
+		for(i = 0; i < 8; i++) {
+			st->x[i][lane] = ctx[lane]->x[i];
+			st->c[i][lane] = ctx[lane]->c[i];
+		}
+		st->carry[lane] = ctx[lane]->carry;
+	}
+}
+
+// Write the lanes back into sixteen contexts
+static void
+rabbit_x16_store(const struct rabbit_x16 *st, struct rabbit_context *ctx[16])
+{
+	int i, lane;
+
+	for(lane = 0; lane < 16; lane++) {
+		for(i = 0; i < 8; i++) {
+			ctx[lane]->x[i] = st->x[i][lane];
+			ctx[lane]->c[i] = st->c[i][lane];
+		}
+		ctx[lane]->carry = st->carry[lane];
+	}
+}
+
+// G-func for sixteen lanes: the 64-bit squares come from two vpmuludq
+static inline __m512i
+rabbit_x16_g_func(__m512i u)
+{
+	__m512i even, odd;
+
+	even = _mm512_mul_epu32(u, u);
+	odd = _mm512_srli_epi64(u, 32);
+	odd = _mm512_mul_epu32(odd, odd);
+
+	even = _mm512_xor_si512(even, _mm512_srli_epi64(even, 32));
+	odd = _mm512_xor_si512(odd, _mm512_slli_epi64(odd, 32));
+
+	return _mm512_mask_blend_epi32(0xAAAA, even, odd);
+}
+
+/*
+ * Calculate the next internal state of the active lanes.
+ * The lanes outside of the mask keep their state unchanged.
+*/
+static inline void
+rabbit_x16_next_state(__m512i x[8], __m512i c[8], __mmask16 *carry, __mmask16 active)
+{
+	const uint32_t a[8] = { RABBIT_A0, RABBIT_A1, RABBIT_A2, RABBIT_A3,
+		RABBIT_A4, RABBIT_A5, RABBIT_A6, RABBIT_A7 };
+	__m512i g[8], c_new;
+	__mmask16 cin;
+	int i;
+
+	// The counter carry chain is a chain of mask registers
+	cin = *carry;
+	for(i = 0; i < 8; i++) {
+		c_new = _mm512_add_epi32(c[i], _mm512_set1_epi32(a[i]));
+		c_new = _mm512_mask_add_epi32(c_new, cin, c_new, _mm512_set1_epi32(1));
+		cin = _mm512_cmplt_epu32_mask(c_new, c[i]);
+		c[i] = _mm512_mask_mov_epi32(c[i], active, c_new);
+	}
+	*carry = (*carry & ~active) | (cin & active);
+
+	for(i = 0; i < 8; i++)
+		g[i] = rabbit_x16_g_func(_mm512_add_epi32(x[i], c[i]));
+
+	x[0] = _mm512_mask_add_epi32(x[0], active, g[0], _mm512_add_epi32(_mm512_rol_epi32(g[7], 16), _mm512_rol_epi32(g[6], 16)));
+	x[1] = _mm512_mask_add_epi32(x[1], active, g[1], _mm512_add_epi32(_mm512_rol_epi32(g[0], 8), g[7]));
+	x[2] = _mm512_mask_add_epi32(x[2], active, g[2], _mm512_add_epi32(_mm512_rol_epi32(g[1], 16), _mm512_rol_epi32(g[0], 16)));
+	x[3] = _mm512_mask_add_epi32(x[3], active, g[3], _mm512_add_epi32(_mm512_rol_epi32(g[2], 8), g[1]));
+	x[4] = _mm512_mask_add_epi32(x[4], active, g[4], _mm512_add_epi32(_mm512_rol_epi32(g[3], 16), _mm512_rol_epi32(g[2], 16)));
+	x[5] = _mm512_mask_add_epi32(x[5], active, g[5], _mm512_add_epi32(_mm512_rol_epi32(g[4], 8), g[3]));
+	x[6] = _mm512_mask_add_epi32(x[6], active, g[6], _mm512_add_epi32(_mm512_rol_epi32(g[5], 16), _mm512_rol_epi32(g[4], 16)));
+	x[7] = _mm512_mask_add_epi32(x[7], active, g[7], _mm512_add_epi32(_mm512_rol_epi32(g[6], 8), g[5]));
+}
+
+/*
+ * Keystream of all lanes after the 4x4 transpose in every 128-bit part.
+ * ks[j] holds the blocks of the lanes j, j+4, j+8, j+12.
+*/
+static inline void
+rabbit_x16_keystream(const __m512i x[8], __m512i ks[4])
+{
+	__m512i s0, s1, s2, s3, t0, t1, t2, t3;
+
+	s0 = _mm512_xor_si512(x[0], _mm512_xor_si512(_mm512_srli_epi32(x[5], 16), _mm512_slli_epi32(x[3], 16)));
+	s1 = _mm512_xor_si512(x[2], _mm512_xor_si512(_mm512_srli_epi32(x[7], 16), _mm512_slli_epi32(x[5], 16)));
+	s2 = _mm512_xor_si512(x[4], _mm512_xor_si512(_mm512_srli_epi32(x[1], 16), _mm512_slli_epi32(x[7], 16)));
+	s3 = _mm512_xor_si512(x[6], _mm512_xor_si512(_mm512_srli_epi32(x[3], 16), _mm512_slli_epi32(x[1], 16)));
+
+	t0 = _mm512_unpacklo_epi32(s0, s1);
+	t1 = _mm512_unpackhi_epi32(s0, s1);
+	t2 = _mm512_unpacklo_epi32(s2, s3);
+	t3 = _mm512_unpackhi_epi32(s2, s3);
+
+	ks[0] = _mm512_unpacklo_epi64(t0, t2);
+	ks[1] = _mm512_unpackhi_epi64(t0, t2);
+	ks[2] = _mm512_unpacklo_epi64(t1, t3);
+	ks[3] = _mm512_unpackhi_epi64(t1, t3);
+}
+
+// Keystream block of the lane from the transposed registers
+#define X16_BLOCK(ks, lane) \
+	_mm512_extracti32x4_epi32(ks[(lane) & 3], (lane) >> 2)
+
+/*
+ * XOR the keystream block into the lane data under the byte mask.
+ * A zero mask touches no memory at all.
+*/
+#define X16_XOR_MASKED(ks, lane, buf, out, k) do {				\
+	__m128i v = _mm_maskz_loadu_epi8(k, buf);				\
+	v = _mm_xor_si128(v, X16_BLOCK(ks, lane));				\
+	_mm_mask_storeu_epi8(out, k, v);					\
+} while(0)
+
+#define X16_XOR(ks, lane, buf, out) do {					\
+	__m128i v = _mm_loadu_si128((const __m128i *)(buf));			\
+	v = _mm_xor_si128(v, X16_BLOCK(ks, lane));				\
+	_mm_storeu_si128((__m128i *)(out), v);					\
+} while(0)
+
+#define X16_FOR_LANES(M)							\
+	M(0); M(1); M(2); M(3); M(4); M(5); M(6); M(7);				\
+	M(8); M(9); M(10); M(11); M(12); M(13); M(14); M(15)
+
+/*
+ * Encrypt the buffers of all lanes up to their own lengths.
+ * st - the transposed state of sixteen contexts
+ * buf, buflen, out - input, length and output of every lane
+ * A lane is advanced once per started block, like rabbit_crypt does.
+*/
+void
+rabbit_x16_crypt(struct rabbit_x16 *st, const uint8_t *buf[16], const uint32_t buflen[16], uint8_t *out[16])
+{
+	__m512i x[8], c[8], ks[4];
+	__mmask16 carry, active, k[16];
+	uint32_t rem[16], full, n, off;
+	int i, lane;
+
+	for(i = 0; i < 8; i++) {
+		x[i] = _mm512_load_si512(st->x[i]);
+		c[i] = _mm512_load_si512(st->c[i]);
+	}
+	carry = _mm512_cmpneq_epi32_mask(_mm512_load_si512(st->carry), _mm512_setzero_si512());
+
+	// Blocks that are full in every lane need no masks
+	full = buflen[0];
+	for(lane = 1; lane < 16; lane++)
+		if(buflen[lane] < full)
+			full = buflen[lane];
+	full /= 16;
+
+	for(n = 0, off = 0; n < full; n++, off += 16) {
+		rabbit_x16_next_state(x, c, &carry, 0xFFFF);
+		rabbit_x16_keystream(x, ks);
+
+#define M(lane)	X16_XOR(ks, lane, buf[lane] + off, out[lane] + off)
+		X16_FOR_LANES(M);
+#undef M
+	}
+
+	// Short buffers and tails: lanes drop out of the mask one by one
+	for(lane = 0; lane < 16; lane++)
+		rem[lane] = buflen[lane] - off;
+
+	for(;;) {
+		active = 0;
+		for(lane = 0; lane < 16; lane++) {
+			if(rem[lane] >= 16)
+				k[lane] = 0xFFFF;
+			else
+				k[lane] = (1U << rem[lane]) - 1;
+			if(rem[lane])
+				active |= 1U << lane;
+		}
+
+		if(!active)
+			break;
+
+		rabbit_x16_next_state(x, c, &carry, active);
+		rabbit_x16_keystream(x, ks);
+
+#define M(lane)	X16_XOR_MASKED(ks, lane, buf[lane] + off, out[lane] + off, k[lane])
+		X16_FOR_LANES(M);
+#undef M
+
+		for(lane = 0; lane < 16; lane++)
+			rem[lane] -= (rem[lane] >= 16) ? 16 : rem[lane];
+		off += 16;
+	}
+
+	for(i = 0; i < 8; i++) {
+		_mm512_store_si512(st->x[i], x[i]);
+		_mm512_store_si512(st->c[i], c[i]);
+	}
+	_mm512_store_si512(st->carry, _mm512_maskz_set1_epi32(carry, 1));
+}
+
+/*
+ * Key setup of sixteen lanes at once, the same steps as rabbit_key_setup.
+ * key - sixteen 16-byte keys
+*/
+void
+rabbit_x16_key_setup(struct rabbit_x16 *st, const uint8_t *key[16])
+{
+	uint32_t kw[4][16] __attribute__((aligned(64)));
+	__m512i x[8], c[8], k0, k1, k2, k3;
+	__mmask16 carry;
+	int i, lane;
+
+	for(lane = 0; lane < 16; lane++)
+		for(i = 0; i < 4; i++)
+			kw[i][lane] = RABBIT_U8TO32_LITTLE((key[lane] + 4*i));
+
+	k0 = _mm512_load_si512(kw[0]);
+	k1 = _mm512_load_si512(kw[1]);
+	k2 = _mm512_load_si512(kw[2]);
+	k3 = _mm512_load_si512(kw[3]);
+
+	x[0] = k0;
+	x[2] = k1;
+	x[4] = k2;
+	x[6] = k3;
+	x[1] = _mm512_or_si512(_mm512_slli_epi32(k3, 16), _mm512_srli_epi32(k2, 16));
+	x[3] = _mm512_or_si512(_mm512_slli_epi32(k0, 16), _mm512_srli_epi32(k3, 16));
+	x[5] = _mm512_or_si512(_mm512_slli_epi32(k1, 16), _mm512_srli_epi32(k0, 16));
+	x[7] = _mm512_or_si512(_mm512_slli_epi32(k2, 16), _mm512_srli_epi32(k1, 16));
+
+	c[0] = _mm512_rol_epi32(k2, 16);
+	c[2] = _mm512_rol_epi32(k3, 16);
+	c[4] = _mm512_rol_epi32(k0, 16);
+	c[6] = _mm512_rol_epi32(k1, 16);
+	// High halves from the first key word, low halves from the second
+	c[1] = _mm512_mask_blend_epi16(0xAAAAAAAA, k1, k0);
+	c[3] = _mm512_mask_blend_epi16(0xAAAAAAAA, k2, k1);
+	c[5] = _mm512_mask_blend_epi16(0xAAAAAAAA, k3, k2);
+	c[7] = _mm512_mask_blend_epi16(0xAAAAAAAA, k0, k3);
+
+	carry = 0;
+
+	for(i = 0; i < 4; i++)
+		rabbit_x16_next_state(x, c, &carry, 0xFFFF);
+
+	for(i = 0; i < 8; i++)
+		c[i] = _mm512_xor_si512(c[i], x[(i+4) & 0x7]);
+
+	for(i = 0; i < 8; i++) {
+		_mm512_store_si512(st->x[i], x[i]);
+		_mm512_store_si512(st->c[i], c[i]);
+	}
+	_mm512_store_si512(st->carry, _mm512_maskz_set1_epi32(carry, 1));
+}
+
+/*
+ * IV setup of sixteen lanes at once, the same steps as rabbit_iv_setup.
+ * st - lanes after the key setup
+ * iv - sixteen 8-byte IVs
+*/
+void
+rabbit_x16_iv_setup(struct rabbit_x16 *st, const uint8_t *iv[16])
+{
+	uint32_t ivw[2][16] __attribute__((aligned(64)));
+	__m512i x[8], c[8], iv0, iv1, iv2, iv3;
+	__mmask16 carry;
+	int i, lane;
+
+	for(i = 0; i < 8; i++) {
+		x[i] = _mm512_load_si512(st->x[i]);
+		c[i] = _mm512_load_si512(st->c[i]);
+	}
+	carry = _mm512_cmpneq_epi32_mask(_mm512_load_si512(st->carry), _mm512_setzero_si512());
+
+	for(lane = 0; lane < 16; lane++) {
+		ivw[0][lane] = RABBIT_U8TO32_LITTLE((iv[lane] + 0));
+		ivw[1][lane] = RABBIT_U8TO32_LITTLE((iv[lane] + 4));
+	}
+
+	iv0 = _mm512_load_si512(ivw[0]);
+	iv1 = _mm512_load_si512(ivw[1]);
+	iv2 = _mm512_or_si512(_mm512_and_si512(iv1, _mm512_set1_epi32(0xffff0000)), _mm512_srli_epi32(iv0, 16));
+	iv3 = _mm512_or_si512(_mm512_slli_epi32(iv1, 16), _mm512_and_si512(iv0, _mm512_set1_epi32(0x0000ffff)));
+
+	c[0] = _mm512_xor_si512(c[0], iv0);
+	c[1] = _mm512_xor_si512(c[1], iv2);
+	c[2] = _mm512_xor_si512(c[2], iv1);
+	c[3] = _mm512_xor_si512(c[3], iv3);
+	c[4] = _mm512_xor_si512(c[4], iv0);
+	c[5] = _mm512_xor_si512(c[5], iv2);
+	c[6] = _mm512_xor_si512(c[6], iv1);
+	c[7] = _mm512_xor_si512(c[7], iv3);
+
+	for(i = 0; i < 4; i++)
+		rabbit_x16_next_state(x, c, &carry, 0xFFFF);
+
+	for(i = 0; i < 8; i++) {
+		_mm512_store_si512(st->x[i], x[i]);
+		_mm512_store_si512(st->c[i], c[i]);
+	}
+	_mm512_store_si512(st->carry, _mm512_maskz_set1_epi32(carry, 1));
+}
+
+// Bulk setup backend: sixteen contexts per call
+void
+rabbit_setup_x16(struct rabbit_context **ctx, const uint8_t **key, const uint8_t **iv)
+{
+	struct rabbit_x16 st;
+
+	rabbit_x16_key_setup(&st, key);
+	if(iv != NULL)
+		rabbit_x16_iv_setup(&st, iv);
+	rabbit_x16_store(&st, ctx);
+	rabbit_wipe(&st, sizeof(st));
+}
+
+// Packet backend: sixteen IV setups from one master state, then the crypt
+void
+rabbit_packets_x16(const struct rabbit_master *master, const uint8_t **iv,
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out)
+{
+	struct rabbit_x16 st;
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		_mm512_store_si512(st.x[i], _mm512_set1_epi32(master->x[i]));
+		_mm512_store_si512(st.c[i], _mm512_set1_epi32(master->c[i]));
+	}
+	_mm512_store_si512(st.carry, _mm512_set1_epi32(master->carry));
+
+	rabbit_x16_iv_setup(&st, iv);
+	rabbit_x16_crypt(&st, buf, buflen, out);
+}
+
+/*
+ * RABBIT crypt of sixteen independent streams.
+ * ctx - sixteen pointers on different RABBIT contexts
+ * buf - sixteen pointers on data buffers
+ * buflen - sixteen lengths of the data buffers, may differ and be zero
+ * out - sixteen pointers on output arrays
+*/
+void
+rabbit_crypt_x16(struct rabbit_context *ctx[16], const uint8_t *buf[16], const uint32_t buflen[16], uint8_t *out[16])
+{
+	struct rabbit_x16 st;
+
+	rabbit_x16_load(&st, ctx);
+	rabbit_x16_crypt(&st, buf, buflen, out);
+	rabbit_x16_store(&st, ctx);
+}
+
+/*
+ * Single-stream kernel: one context, x[8] and c[8] in one 256-bit
+ * register each. The same carry-lookahead as the AVX2 kernel, with
+ * the lane masks coming straight from the compares and vprolvd
+ * doing the per-lane rotations.
+*/
+
+// Calculate the next internal state of one context
+static inline void
+rabbit_avx512_next_state(__m256i *x, __m256i *c, uint32_t *carry)
+{
+	const __m256i a = _mm256_setr_epi32(RABBIT_A0, RABBIT_A1, RABBIT_A2, RABBIT_A3,
+		RABBIT_A4, RABBIT_A5, RABBIT_A6, RABBIT_A7);
+	const __m256i prev1 = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+	const __m256i prev2 = _mm256_setr_epi32(6, 7, 0, 1, 2, 3, 4, 5);
+	const __m256i rot1 = _mm256_setr_epi32(16, 8, 16, 8, 16, 8, 16, 8);
+	const __m256i rot2 = _mm256_setr_epi32(16, 0, 16, 0, 16, 0, 16, 0);
+	__m256i s, u, even, odd, g;
+	uint32_t gen, prop, t;
+
+	s = _mm256_add_epi32(*c, a);
+	gen = _mm256_cmplt_epu32_mask(s, *c);
+	prop = _mm256_cmpeq_epi32_mask(s, _mm256_set1_epi32(-1));
+
+	t = (((gen << 1) | *carry) + prop) ^ prop;
+	*carry = t >> 8;
+
+	*c = _mm256_mask_add_epi32(s, (__mmask8)t, s, _mm256_set1_epi32(1));
+
+	u = _mm256_add_epi32(*x, *c);
+	even = _mm256_mul_epu32(u, u);
+	odd = _mm256_srli_epi64(u, 32);
+	odd = _mm256_mul_epu32(odd, odd);
+	even = _mm256_xor_si256(even, _mm256_srli_epi64(even, 32));
+	odd = _mm256_xor_si256(odd, _mm256_slli_epi64(odd, 32));
+	g = _mm256_mask_blend_epi32(0xAA, even, odd);
+
+	*x = _mm256_add_epi32(g, _mm256_add_epi32(
+		_mm256_rolv_epi32(_mm256_permutexvar_epi32(prev1, g), rot1),
+		_mm256_rolv_epi32(_mm256_permutexvar_epi32(prev2, g), rot2)));
+}
+
+// Keystream block of one context in the low 128 bits
+static inline __m128i
+rabbit_avx512_keystream(__m256i x)
+{
+	const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	const __m256i hi = _mm256_setr_epi32(5, 7, 1, 3, 5, 7, 1, 3);
+	const __m256i lo = _mm256_setr_epi32(3, 5, 7, 1, 3, 5, 7, 1);
+	__m256i s;
+
+	// 0x96 - three-way XOR
+	s = _mm256_ternarylogic_epi32(_mm256_permutexvar_epi32(even, x),
+		_mm256_srli_epi32(_mm256_permutexvar_epi32(hi, x), 16),
+		_mm256_slli_epi32(_mm256_permutexvar_epi32(lo, x), 16), 0x96);
+
+	return _mm256_castsi256_si128(s);
+}
+
+// Single-stream backend: the tail block goes through a masked load and store
+void
+rabbit_crypt_avx512(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	__m256i x, c;
+	__m128i ks;
+	__mmask16 k;
+	uint32_t carry;
+
+	x = _mm256_loadu_si256((const __m256i *)ctx->x);
+	c = _mm256_loadu_si256((const __m256i *)ctx->c);
+	carry = ctx->carry;
+
+	for(; buflen >= 16; buflen -= 16, buf += 16, out += 16) {
+		rabbit_avx512_next_state(&x, &c, &carry);
+
+		ks = rabbit_avx512_keystream(x);
+		_mm_storeu_si128((__m128i *)out, _mm_xor_si128(ks, _mm_loadu_si128((const __m128i *)buf)));
+	}
+
+	if(buflen) {
+		rabbit_avx512_next_state(&x, &c, &carry);
+
+		k = (1U << buflen) - 1;
+		ks = _mm_xor_si128(rabbit_avx512_keystream(x), _mm_maskz_loadu_epi8(k, buf));
+		_mm_mask_storeu_epi8(out, k, ks);
+	}
+
+	_mm256_storeu_si256((__m256i *)ctx->x, x);
+	_mm256_storeu_si256((__m256i *)ctx->c, c);
+	ctx->carry = carry;
+}
+
+// Keystream generation without the data
+void
+rabbit_keystream_avx512(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks)
+{
+	__m256i x, c;
+	uint32_t carry;
+
+	x = _mm256_loadu_si256((const __m256i *)ctx->x);
+	c = _mm256_loadu_si256((const __m256i *)ctx->c);
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--, ks += 16) {
+		rabbit_avx512_next_state(&x, &c, &carry);
+		_mm_store_si128((__m128i *)ks, rabbit_avx512_keystream(x));
+	}
+
+	_mm256_storeu_si256((__m256i *)ctx->x, x);
+	_mm256_storeu_si256((__m256i *)ctx->c, c);
+	ctx->carry = carry;
+}
+
+// Advance the state without the keystream output
+void
+rabbit_skip_avx512(struct rabbit_context *ctx, uint64_t nblocks)
+{
+	__m256i x, c;
+	uint32_t carry;
+
+	x = _mm256_loadu_si256((const __m256i *)ctx->x);
+	c = _mm256_loadu_si256((const __m256i *)ctx->c);
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--)
+		rabbit_avx512_next_state(&x, &c, &carry);
+
+	_mm256_storeu_si256((__m256i *)ctx->x, x);
+	_mm256_storeu_si256((__m256i *)ctx->c, c);
+	ctx->carry = carry;
+}
+
+/*
+ * XOR a keystream tile into the data with 512-bit loads.
+ * The head is peeled with a masked store up to the 64-byte alignment
+ * of out, then no store splits a cache line. With nt they bypass the
+ * caches. The last partial vector goes through a masked load and store.
+*/
+void
+rabbit_xor_avx512(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt)
+{
+	__m512i v;
+	__mmask64 k;
+	uint32_t head;
+
+	head = (64 - ((uintptr_t)out & 63)) & 63;
+	if(head > len)
+		head = len;
+	k = (1ULL << head) - 1;
+	v = _mm512_xor_si512(_mm512_maskz_loadu_epi8(k, buf), _mm512_maskz_loadu_epi8(k, ks));
+	_mm512_mask_storeu_epi8(out, k, v);
+	out += head, buf += head, ks += head, len -= head;
+
+	if(nt) {
+		for(; len >= 64; len -= 64, buf += 64, ks += 64, out += 64) {
+			v = _mm512_xor_si512(_mm512_loadu_si512(buf), _mm512_loadu_si512(ks));
+			_mm512_stream_si512((__m512i *)out, v);
+		}
+	}
+
+	for(; len >= 64; len -= 64, buf += 64, ks += 64, out += 64) {
+		v = _mm512_xor_si512(_mm512_loadu_si512(buf), _mm512_loadu_si512(ks));
+		_mm512_store_si512(out, v);
+	}
+
+	if(len) {
+		k = (1ULL << len) - 1;
+		v = _mm512_xor_si512(_mm512_maskz_loadu_epi8(k, buf), _mm512_maskz_loadu_epi8(k, ks));
+		_mm512_mask_storeu_epi8(out, k, v);
+	}
+}
@@ -0,0 +1,218 @@
+/*
+ * Runtime selection of the RABBIT-128 backend.
+ * The backend is chosen once, at the first rabbit_crypt call:
+ * - RABBIT_BACKEND=<name> forces a backend (scalar, sse2, avx2, avx512)
+ * - RABBIT_BACKEND=bench times every supported backend and takes the fastest
+ * - otherwise the widest backend supported by the CPU (CPUID) is used
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+
+#define BENCH_LEN	65536
+#define BENCH_ROUNDS	8
+
+static int
+supported_scalar(void)
+{
+	return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int
+supported_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static int
+supported_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static int
+supported_avx512(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+		__builtin_cpu_supports("avx512vl");
+}
+#endif
+
+// The registry, from the most portable backend to the widest one
+static const struct rabbit_backend backends[] = {
+	{ "scalar", supported_scalar, rabbit_crypt_scalar, rabbit_keystream_scalar, rabbit_skip_scalar,
+		rabbit_xor_scalar, 1,  NULL, NULL },
+#if defined(__x86_64__) || defined(__i386__)
+	{ "sse2",   supported_sse2,   rabbit_crypt_sse2,   rabbit_keystream_sse2,   rabbit_skip_sse2,
+		rabbit_xor_sse2,   1,  NULL, NULL },
+	{ "avx2",   supported_avx2,   rabbit_crypt_avx2,   rabbit_keystream_avx2,   rabbit_skip_avx2,
+		rabbit_xor_avx2,   8,  rabbit_setup_x8, rabbit_packets_x8 },
+	{ "avx512", supported_avx512, rabbit_crypt_avx512, rabbit_keystream_avx512, rabbit_skip_avx512,
+		rabbit_xor_avx512, 16, rabbit_setup_x16, rabbit_packets_x16 },
+#endif
+};
+
+#define NBACKENDS	(sizeof(backends) / sizeof(backends[0]))
+
+static const struct rabbit_backend *selected;
+
+// Time BENCH_ROUNDS passes over BENCH_LEN bytes, in nanoseconds
+static uint64_t
+backend_bench(const struct rabbit_backend *b, const uint8_t *buf, uint8_t *out)
+{
+	struct rabbit_context ctx;
+	struct timespec t1, t2;
+	uint8_t key[16], iv[8];
+	int i;
+
+	memset(key, 'k', sizeof(key));
+	memset(iv, 'i', sizeof(iv));
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+
+	// The first pass warms up the caches
+	b->crypt(&ctx, buf, BENCH_LEN, out);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for(i = 0; i < BENCH_ROUNDS; i++)
+		b->crypt(&ctx, buf, BENCH_LEN, out);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	return (uint64_t)(t2.tv_sec - t1.tv_sec) * 1000000000 + t2.tv_nsec - t1.tv_nsec;
+}
+
+// The fastest supported backend on this host
+static const struct rabbit_backend *
+backend_fastest(void)
+{
+	const struct rabbit_backend *best = &backends[0];
+	uint64_t t, best_time = UINT64_MAX;
+	uint8_t *buf, *out;
+	size_t i;
+
+	buf = calloc(1, BENCH_LEN);
+	out = malloc(BENCH_LEN);
+
+	if(buf == NULL || out == NULL) {
+		free(buf);
+		free(out);
+		return best;
+	}
+
+	for(i = 0; i < NBACKENDS; i++) {
+		if(!backends[i].supported())
+			continue;
+
+		t = backend_bench(&backends[i], buf, out);
+		if(t < best_time) {
+			best_time = t;
+			best = &backends[i];
+		}
+	}
+
+	free(buf);
+	free(out);
+
+	return best;
+}
+
+// The widest supported backend
+static const struct rabbit_backend *
+backend_widest(void)
+{
+	size_t i;
+
+	for(i = NBACKENDS; i > 0; i--)
+		if(backends[i - 1].supported())
+			return &backends[i - 1];
+
+	return &backends[0];
+}
+
+// Supported backend by name, NULL if it is unknown or unsupported
+static const struct rabbit_backend *
+backend_find(const char *name)
+{
+	size_t i;
+
+	for(i = 0; i < NBACKENDS; i++)
+		if(!strcmp(backends[i].name, name))
+			return backends[i].supported() ? &backends[i] : NULL;
+
+	return NULL;
+}
+
+static const struct rabbit_backend *
+backend_choose(void)
+{
+	const struct rabbit_backend *b;
+	const char *env;
+
+	env = getenv("RABBIT_BACKEND");
+
+	if(env == NULL || *env == '\0' || !strcmp(env, "auto"))
+		return backend_widest();
+
+	if(!strcmp(env, "bench"))
+		return backend_fastest();
+
+	if((b = backend_find(env)) != NULL)
+		return b;
+
+	fprintf(stderr, "rabbit: backend '%s' is not available, using auto\n", env);
+
+	return backend_widest();
+}
+
+/*
+ * The backend of rabbit_crypt, chosen at the first use.
+ * Concurrent first calls may both choose, either result is a valid backend.
+*/
+const struct rabbit_backend *
+rabbit_backend_get(void)
+{
+	const struct rabbit_backend *b;
+
+	b = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+	if(b == NULL) {
+		b = backend_choose();
+		__atomic_store_n(&selected, b, __ATOMIC_RELEASE);
+	}
+
+	return b;
+}
+
+// Name of the backend used by rabbit_crypt
+const char *
+rabbit_backend(void)
+{
+	return rabbit_backend_get()->name;
+}
+
+// Force a backend by name
+// Return value: 0 (if all is well), -1 (unknown or unsupported backend)
+int
+rabbit_backend_select(const char *name)
+{
+	const struct rabbit_backend *b;
+
+	if(!strcmp(name, "auto"))
+		b = backend_widest();
+	else if(!strcmp(name, "bench"))
+		b = backend_fastest();
+	else if((b = backend_find(name)) == NULL)
+		return -1;
+
+	__atomic_store_n(&selected, b, __ATOMIC_RELEASE);
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * Compile-time RABBIT-128 (C++20).
+ * The functions of rabbit_core.h are constexpr in C++20, so the key
+ * schedule of a fixed key can be done by the compiler:
+ *
+ *	constexpr struct rabbit_master m = rabbit::key_schedule(key);
+ *	rabbit_master_setup(&ctx, &m);
+ *
+ * The scalar backend runs the same code. The SIMD backends have their
+ * own step and schedules, testwrapper checks each of them against
+ * this header at run time.
+ * The test vectors of rabbit_sources/test-vectors.txt are checked
+ * with static_assert, "make check" compiles this header alone.
+*/
+
+#ifndef RABBIT_CONSTEXPR_HPP
+#define RABBIT_CONSTEXPR_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "rabbit.h"
+#include "rabbit_core.h"
+
+namespace rabbit {
+
+using key_bytes = std::array<uint8_t, 16>;
+using iv_bytes = std::array<uint8_t, 8>;
+
+// Master state of a 16-byte key
+constexpr struct rabbit_master
+key_schedule(const key_bytes &key)
+{
+	struct rabbit_master m{};
+
+	rabbit_core_key_schedule(key.data(), m.x, m.c, &m.carry);
+
+	return m;
+}
+
+namespace detail {
+
+// Byte i of an extracted keystream word, in the memory order
+constexpr uint8_t
+keystream_byte(uint32_t w, int i)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return (uint8_t)(w >> (8 * i));
+#else
+	return (uint8_t)(w >> (24 - 8 * i));
+#endif
+}
+
+// N keystream bytes from a state, Unroll blocks per iteration like the runtime core
+template <std::size_t N, int Unroll>
+constexpr std::array<uint8_t, N>
+keystream(struct rabbit_master s)
+{
+	static_assert(Unroll > 0, "the unroll factor must be positive");
+
+	std::array<uint8_t, N> out{};
+	uint32_t ks[4 * Unroll]{};
+	std::size_t pos = 0, i;
+	int u;
+
+	while(pos < N) {
+		for(u = 0; u < Unroll && pos + 16 * u < N; u++) {
+			rabbit_core_step(s.x, s.c, &s.carry);
+			rabbit_core_extract(s.x, ks + 4 * u);
+		}
+
+		for(i = 0; i < 16 * (std::size_t)u && pos < N; i++, pos++)
+			out[pos] = keystream_byte(ks[i / 4], i % 4);
+	}
+
+	return out;
+}
+
+}
+
+// The first N keystream bytes of a master state without an IV
+template <std::size_t N, int Unroll = 4>
+constexpr std::array<uint8_t, N>
+keystream(const struct rabbit_master &m)
+{
+	return detail::keystream<N, Unroll>(m);
+}
+
+// The first N keystream bytes of a master state with an IV
+template <std::size_t N, int Unroll = 4>
+constexpr std::array<uint8_t, N>
+keystream(const struct rabbit_master &m, const iv_bytes &iv)
+{
+	struct rabbit_master s = m;
+
+	rabbit_core_iv_schedule(iv.data(), s.x, s.c, &s.carry);
+
+	return detail::keystream<N, Unroll>(s);
+}
+
+namespace test {
+
+/*
+ * rabbit_sources/test-vectors.txt, tests 1 - 6.
+ * Only the first two blocks of the key-only tests 1 - 3 are used: the
+ * third block printed in the file agrees neither with the eSTREAM
+ * reference code next to it nor with RFC 4503.
+*/
+constexpr key_bytes key0{};
+constexpr key_bytes key2{ 0xC2, 0x1F, 0xCF, 0x38, 0x81, 0xCD, 0x5E, 0xE8,
+			  0x62, 0x8A, 0xCC, 0xB0, 0xA9, 0x89, 0x0D, 0xF8 };
+constexpr key_bytes key3{ 0x1D, 0x27, 0x2C, 0x6A, 0x2D, 0x8E, 0x3D, 0xFC,
+			  0xAC, 0x14, 0x05, 0x6B, 0x78, 0xD6, 0x33, 0xA0 };
+constexpr iv_bytes iv4{};
+constexpr iv_bytes iv5{ 0x59, 0x7E, 0x26, 0xC1, 0x75, 0xF5, 0x73, 0xC3 };
+constexpr iv_bytes iv6{ 0x27, 0x17, 0xF4, 0xD2, 0x1A, 0x56, 0xEB, 0xA6 };
+
+constexpr std::array<uint8_t, 32> out1{
+	0x02, 0xF7, 0x4A, 0x1C, 0x26, 0x45, 0x6B, 0xF5, 0xEC, 0xD6, 0xA5, 0x36, 0xF0, 0x54, 0x57, 0xB1,
+	0xA7, 0x8A, 0xC6, 0x89, 0x47, 0x6C, 0x69, 0x7B, 0x39, 0x0C, 0x9C, 0xC5, 0x15, 0xD8, 0xE8, 0x88 };
+constexpr std::array<uint8_t, 32> out2{
+	0x3D, 0x02, 0xE0, 0xC7, 0x30, 0x55, 0x91, 0x12, 0xB4, 0x73, 0xB7, 0x90, 0xDE, 0xE0, 0x18, 0xDF,
+	0xCD, 0x6D, 0x73, 0x0C, 0xE5, 0x4E, 0x19, 0xF0, 0xC3, 0x5E, 0xC4, 0x79, 0x0E, 0xB6, 0xC7, 0x4A };
+constexpr std::array<uint8_t, 32> out3{
+	0xA3, 0xA9, 0x7A, 0xBB, 0x80, 0x39, 0x38, 0x20, 0xB7, 0xE5, 0x0C, 0x4A, 0xBB, 0x53, 0x82, 0x3D,
+	0xC4, 0x42, 0x37, 0x99, 0xC2, 0xEF, 0xC9, 0xFF, 0xB3, 0xA4, 0x12, 0x5F, 0x1F, 0x4C, 0x99, 0xA8 };
+constexpr std::array<uint8_t, 48> out4{
+	0xED, 0xB7, 0x05, 0x67, 0x37, 0x5D, 0xCD, 0x7C, 0xD8, 0x95, 0x54, 0xF8, 0x5E, 0x27, 0xA7, 0xC6,
+	0x8D, 0x4A, 0xDC, 0x70, 0x32, 0x29, 0x8F, 0x7B, 0xD4, 0xEF, 0xF5, 0x04, 0xAC, 0xA6, 0x29, 0x5F,
+	0x66, 0x8F, 0xBF, 0x47, 0x8A, 0xDB, 0x2B, 0xE5, 0x1E, 0x6C, 0xDE, 0x29, 0x2B, 0x82, 0xDE, 0x2A };
+constexpr std::array<uint8_t, 48> out5{
+	0x6D, 0x7D, 0x01, 0x22, 0x92, 0xCC, 0xDC, 0xE0, 0xE2, 0x12, 0x00, 0x58, 0xB9, 0x4E, 0xCD, 0x1F,
+	0x2E, 0x6F, 0x93, 0xED, 0xFF, 0x99, 0x24, 0x7B, 0x01, 0x25, 0x21, 0xD1, 0x10, 0x4E, 0x5F, 0xA7,
+	0xA7, 0x9B, 0x02, 0x12, 0xD0, 0xBD, 0x56, 0x23, 0x39, 0x38, 0xE7, 0x93, 0xC3, 0x12, 0xC1, 0xEB };
+constexpr std::array<uint8_t, 48> out6{
+	0x4D, 0x10, 0x51, 0xA1, 0x23, 0xAF, 0xB6, 0x70, 0xBF, 0x8D, 0x85, 0x05, 0xC8, 0xD8, 0x5A, 0x44,
+	0x03, 0x5B, 0xC3, 0xAC, 0xC6, 0x67, 0xAE, 0xAE, 0x5B, 0x2C, 0xF4, 0x47, 0x79, 0xF2, 0xC8, 0x96,
+	0xCB, 0x51, 0x15, 0xF0, 0x34, 0xF0, 0x3D, 0x31, 0x17, 0x1C, 0xA7, 0x5F, 0x89, 0xFC, 0xCB, 0x9F };
+
+static_assert(keystream<32>(key_schedule(key0)) == out1, "test vector 1");
+static_assert(keystream<32>(key_schedule(key2)) == out2, "test vector 2");
+static_assert(keystream<32>(key_schedule(key3)) == out3, "test vector 3");
+static_assert(keystream<48>(key_schedule(key0), iv4) == out4, "test vector 4");
+static_assert(keystream<48>(key_schedule(key0), iv5) == out5, "test vector 5");
+static_assert(keystream<48>(key_schedule(key0), iv6) == out6, "test vector 6");
+
+// Every unroll factor gives the same keystream
+static_assert(keystream<32, 1>(key_schedule(key2)) == out2, "unroll 1");
+static_assert(keystream<32, 3>(key_schedule(key3)) == out3, "unroll 3");
+static_assert(keystream<48, 8>(key_schedule(key0), iv6) == out6, "unroll 8");
+
+}
+
+}
+
+#endif
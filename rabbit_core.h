@@ -0,0 +1,265 @@
+/* 
+ * The portable RABBIT-128 core.
+ * Every backend includes it and builds it with its own compiler flags,
+ * so the same C code is specialized for each instruction set.
+ * The step, the output and the key/IV schedules are also constexpr
+ * in C++20: rabbit_constexpr.hpp evaluates them at compile time.
+*/
+
+#ifndef RABBIT_CORE_H
+#define RABBIT_CORE_H
+
+#include "rabbit_internal.h"
+
+#if defined(__cplusplus) && __cplusplus >= 202002L
+#define RABBIT_CONSTEXPR	constexpr
+#else
+#define RABBIT_CONSTEXPR
+#endif
+
+/* 
+ * One step of the state on the caller's variables.
+ * x - the state variables
+ * c - the counter system
+ * carry - the counter carry bit
+ * The counters are chained through 64-bit sums, so no copy of
+ * the old counters is needed. With x and c being locals of the
+ * caller, the whole step is done in registers.
+*/
+static inline __attribute__((always_inline)) RABBIT_CONSTEXPR void
+rabbit_core_step(uint32_t x[8], uint32_t c[8], uint32_t *carry)
+{
+	const uint32_t a[8] = { RABBIT_A0, RABBIT_A1, RABBIT_A2, RABBIT_A3,
+		RABBIT_A4, RABBIT_A5, RABBIT_A6, RABBIT_A7 };
+	uint32_t g[8], cy;
+	uint64_t t;
+	int i;
+
+	cy = *carry;
+	for(i = 0; i < 8; i++) {
+		t = (uint64_t)c[i] + a[i] + cy;
+		c[i] = (uint32_t)t;
+		cy = (uint32_t)(t >> 32);
+	}
+	*carry = cy;
+
+	for(i = 0; i < 8; i++)
+		RABBIT_G_FUNC((x[i] + c[i]), g[i]);
+
+	x[0] = g[0] + RABBIT_ROTL32(g[7], 16) + RABBIT_ROTL32(g[6], 16);
+	x[1] = g[1] + RABBIT_ROTL32(g[0], 8) + g[7];
+	x[2] = g[2] + RABBIT_ROTL32(g[1], 16) + RABBIT_ROTL32(g[0], 16);
+	x[3] = g[3] + RABBIT_ROTL32(g[2], 8) + g[1];
+	x[4] = g[4] + RABBIT_ROTL32(g[3], 16) + RABBIT_ROTL32(g[2], 16);
+	x[5] = g[5] + RABBIT_ROTL32(g[4], 8) + g[3];
+	x[6] = g[6] + RABBIT_ROTL32(g[5], 16) + RABBIT_ROTL32(g[4], 16);
+	x[7] = g[7] + RABBIT_ROTL32(g[6], 8) + g[5];
+}
+
+// Extract one keystream block (in the memory byte order) from the state
+static inline __attribute__((always_inline)) RABBIT_CONSTEXPR void
+rabbit_core_extract(const uint32_t x[8], uint32_t ks[4])
+{
+	ks[0] = RABBIT_U32TO32((x[0] ^ (x[5] >> 16) ^ (x[3] << 16)));
+	ks[1] = RABBIT_U32TO32((x[2] ^ (x[7] >> 16) ^ (x[5] << 16)));
+	ks[2] = RABBIT_U32TO32((x[4] ^ (x[1] >> 16) ^ (x[7] << 16)));
+	ks[3] = RABBIT_U32TO32((x[6] ^ (x[3] >> 16) ^ (x[1] << 16)));
+}
+
+// Calculate the next internal state
+static inline void
+rabbit_next_state(struct rabbit_context *ctx)
+{
+	rabbit_core_step(ctx->x, ctx->c, &ctx->carry);
+}
+
+// Key schedule on the caller's variables, key - 16 bytes, zero-padded
+static inline RABBIT_CONSTEXPR void
+rabbit_core_key_schedule(const uint8_t *key, uint32_t x[8], uint32_t c[8], uint32_t *carry)
+{
+	uint32_t k0, k1, k2, k3;
+	int i;
+
+	// Copy the secret key into 4 parts
+	k0 = RABBIT_U8TO32_LITTLE((key + 0));
+	k1 = RABBIT_U8TO32_LITTLE((key + 4));
+	k2 = RABBIT_U8TO32_LITTLE((key + 8));
+	k3 = RABBIT_U8TO32_LITTLE((key + 12));
+	
+	x[0] = k0;
+	x[2] = k1;
+	x[4] = k2;
+	x[6] = k3;
+	x[1] = (k3 << 16) | (k2 >> 16);
+	x[3] = (k0 << 16) | (k3 >> 16);
+	x[5] = (k1 << 16) | (k0 >> 16);
+	x[7] = (k2 << 16) | (k1 >> 16);
+
+	c[0] = (k2 << 16) | (k2 >> 16);
+	c[2] = (k3 << 16) | (k3 >> 16);
+	c[4] = (k0 << 16) | (k0 >> 16);
+	c[6] = (k1 << 16) | (k1 >> 16);
+	c[1] = (k0 & 0xffff0000) | (k1 & 0x0000ffff);
+	c[3] = (k1 & 0xffff0000) | (k2 & 0x0000ffff);
+	c[5] = (k2 & 0xffff0000) | (k3 & 0x0000ffff);
+	c[7] = (k3 & 0xffff0000) | (k0 & 0x0000ffff);
+	
+	*carry = 0;
+
+	for(i = 0; i < 4; i++)
+		rabbit_core_step(x, c, carry);
+	
+	// (i+4) & 0x7 = (i+4) % 8
+	for(i = 0; i < 8; i++)
+		c[i] ^= x[(i+4) & 0x7];
+}
+
+// IV schedule on the caller's variables, iv - 8 bytes, zero-padded
+static inline RABBIT_CONSTEXPR void
+rabbit_core_iv_schedule(const uint8_t *iv, uint32_t x[8], uint32_t c[8], uint32_t *carry)
+{
+	uint32_t iv0, iv1, iv2, iv3;
+	int i;
+	
+	iv0 = RABBIT_U8TO32_LITTLE((iv + 0));
+	iv1 = RABBIT_U8TO32_LITTLE((iv + 4));
+	iv2 = (iv1 & 0xffff0000) | (iv0 >> 16);
+	iv3 = (iv1 << 16) | (iv0 & 0x0000ffff);
+		
+	c[0] ^= iv0;
+	c[1] ^= iv2;
+	c[2] ^= iv1;
+	c[3] ^= iv3;
+	c[4] ^= iv0;
+	c[5] ^= iv2;
+	c[6] ^= iv1;
+	c[7] ^= iv3;
+	
+	for(i = 0; i < 4; i++)
+		rabbit_core_step(x, c, carry);
+}
+
+/* 
+ * RABBIT crypt algorithm.
+ * ctx - pointer on RABBIT context
+ * buf - pointer on buffer data
+ * buflen - length the data buffer
+ * out - pointer on output array
+ * The state is loaded into locals once per call, four blocks (64 bytes)
+ * are generated per iteration and the state is written back at the end.
+ * The data goes through memcpy words: any alignment, and every word is
+ * read before it is written, so buf may be equal to out.
+*/
+static inline void
+rabbit_core_crypt(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	uint32_t x[8], c[8], carry, keystream[16];
+	uint32_t i, w;
+
+	memcpy(x, ctx->x, sizeof(x));
+	memcpy(c, ctx->c, sizeof(c));
+	carry = ctx->carry;
+
+	for(; buflen >= 64; buflen -= 64, buf += 64, out += 64) {
+		rabbit_core_step(x, c, &carry);
+		rabbit_core_extract(x, keystream + 0);
+		rabbit_core_step(x, c, &carry);
+		rabbit_core_extract(x, keystream + 4);
+		rabbit_core_step(x, c, &carry);
+		rabbit_core_extract(x, keystream + 8);
+		rabbit_core_step(x, c, &carry);
+		rabbit_core_extract(x, keystream + 12);
+
+		for(i = 0; i < 16; i++) {
+			memcpy(&w, buf + 4*i, 4);
+			w ^= keystream[i];
+			memcpy(out + 4*i, &w, 4);
+		}
+	}
+
+	for(; buflen >= 16; buflen -= 16, buf += 16, out += 16) {
+		rabbit_core_step(x, c, &carry);
+		rabbit_core_extract(x, keystream);
+
+		for(i = 0; i < 4; i++) {
+			memcpy(&w, buf + 4*i, 4);
+			w ^= keystream[i];
+			memcpy(out + 4*i, &w, 4);
+		}
+	}
+
+	if(buflen) {
+		rabbit_core_step(x, c, &carry);
+		rabbit_core_extract(x, keystream);
+
+		for(i = 0; i < buflen; i++)
+			out[i] = buf[i] ^ ((uint8_t *)keystream)[i];
+	}
+
+	memcpy(ctx->x, x, sizeof(x));
+	memcpy(ctx->c, c, sizeof(c));
+	ctx->carry = carry;
+}
+
+/* 
+ * Keystream generation without the data.
+ * ctx - pointer on RABBIT context
+ * ks - output of nblocks * 16 bytes
+ * nblocks - number of keystream blocks
+*/
+static inline void
+rabbit_core_keystream(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks)
+{
+	uint32_t x[8], c[8], carry, keystream[4];
+
+	memcpy(x, ctx->x, sizeof(x));
+	memcpy(c, ctx->c, sizeof(c));
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--, ks += 16) {
+		rabbit_core_step(x, c, &carry);
+		rabbit_core_extract(x, keystream);
+		memcpy(ks, keystream, 16);
+	}
+
+	memcpy(ctx->x, x, sizeof(x));
+	memcpy(ctx->c, c, sizeof(c));
+	ctx->carry = carry;
+}
+
+// Advance the state by nblocks blocks, the state stays in locals
+static inline void
+rabbit_core_skip(struct rabbit_context *ctx, uint64_t nblocks)
+{
+	uint32_t x[8], c[8], carry;
+
+	memcpy(x, ctx->x, sizeof(x));
+	memcpy(c, ctx->c, sizeof(c));
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--)
+		rabbit_core_step(x, c, &carry);
+
+	memcpy(ctx->x, x, sizeof(x));
+	memcpy(ctx->c, c, sizeof(c));
+	ctx->carry = carry;
+}
+
+// XOR len bytes of the keystream tile into the data, 8 bytes at a time
+static inline void
+rabbit_core_xor(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len)
+{
+	uint64_t a, b;
+
+	for(; len >= 8; len -= 8, buf += 8, ks += 8, out += 8) {
+		memcpy(&a, buf, 8);
+		memcpy(&b, ks, 8);
+		a ^= b;
+		memcpy(out, &a, 8);
+	}
+
+	for(; len; len--)
+		*out++ = *buf++ ^ *ks++;
+}
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * CRC32C (Castagnoli) integrity check of the RABBIT-128 library.
+ * The hardware or the table implementation is chosen at the first call.
+ * The keystream is generated into an L1 tile by the backend, the tile
+ * is then XORed into the data with the CRC in the same loop.
+ * The table code processes eight bytes at a time (slicing-by-8).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_crc32c.h"
+
+// CRC32C polynomial, reflected
+#define POLY	0x82F63B78
+
+/*
+ * CRC32C implementation.
+ * update - CRC of a buffer, the CRC is not inverted
+ * xor - XOR of a keystream tile into the data and CRC of the ciphertext
+*/
+struct crc_impl {
+	uint32_t (*update)(uint32_t crc, const uint8_t *buf, size_t len);
+	uint32_t (*xor)(uint8_t *out, const uint8_t *buf, const uint8_t *ks, size_t len,
+		uint32_t crc, int decrypt);
+};
+
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static const struct crc_impl *crc_selected;
+
+static void
+crc_table_setup(void)
+{
+	uint32_t c;
+	int i, j;
+
+	for(i = 0; i < 256; i++) {
+		c = i;
+		for(j = 0; j < 8; j++)
+			c = (c >> 1) ^ (POLY & -(c & 1));
+		crc_table[0][i] = c;
+	}
+
+	for(i = 0; i < 256; i++)
+		for(j = 1; j < 8; j++)
+			crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^ crc_table[0][crc_table[j - 1][i] & 0xFF];
+}
+
+// Eight bytes of the little-endian word w
+static inline uint32_t
+crc_table_word(uint32_t crc, uint64_t w)
+{
+	w ^= crc;
+
+	return crc_table[7][w & 0xFF] ^ crc_table[6][(w >> 8) & 0xFF] ^
+		crc_table[5][(w >> 16) & 0xFF] ^ crc_table[4][(w >> 24) & 0xFF] ^
+		crc_table[3][(w >> 32) & 0xFF] ^ crc_table[2][(w >> 40) & 0xFF] ^
+		crc_table[1][(w >> 48) & 0xFF] ^ crc_table[0][w >> 56];
+}
+
+// The bytes of a word loaded with memcpy, in little-endian order
+static inline uint64_t
+crc_le64(uint64_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	w = __builtin_bswap64(w);
+#endif
+	return w;
+}
+
+static uint32_t
+crc_update_table(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	uint64_t w;
+
+	for(; len >= 8; len -= 8, buf += 8) {
+		memcpy(&w, buf, 8);
+		crc = crc_table_word(crc, crc_le64(w));
+	}
+
+	for(; len; len--, buf++)
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *buf) & 0xFF];
+
+	return crc;
+}
+
+static uint32_t
+crc_xor_table(uint8_t *out, const uint8_t *buf, const uint8_t *ks, size_t len,
+	uint32_t crc, int decrypt)
+{
+	uint64_t w, k;
+
+	for(; len >= 8; len -= 8, buf += 8, ks += 8, out += 8) {
+		memcpy(&w, buf, 8);
+		memcpy(&k, ks, 8);
+		crc = crc_table_word(crc, crc_le64(decrypt ? w : w ^ k));
+		w ^= k;
+		memcpy(out, &w, 8);
+	}
+
+	for(; len; len--, buf++, ks++, out++) {
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ (decrypt ? *buf : *buf ^ *ks)) & 0xFF];
+		*out = *buf ^ *ks;
+	}
+
+	return crc;
+}
+
+static const struct crc_impl crc_impl_table = { crc_update_table, crc_xor_table };
+
+#if defined(__x86_64__)
+static const struct crc_impl crc_impl_sse42 = { rabbit_crc32c_sse42, rabbit_crc32c_xor_sse42 };
+#endif
+
+// The implementation, chosen once from CPUID
+static const struct crc_impl *
+crc_get(void)
+{
+	const struct crc_impl *c;
+
+	c = __atomic_load_n(&crc_selected, __ATOMIC_ACQUIRE);
+	if(c != NULL)
+		return c;
+
+	c = &crc_impl_table;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse4.2"))
+		c = &crc_impl_sse42;
+#endif
+
+	if(c == &crc_impl_table)
+		pthread_once(&crc_table_once, crc_table_setup);
+
+	__atomic_store_n(&crc_selected, c, __ATOMIC_RELEASE);
+
+	return c;
+}
+
+// Force the implementation: "table", "sse42" or "auto" (CPUID again)
+int
+rabbit_crc32c_select(const char *name)
+{
+	const struct crc_impl *c;
+
+	if(!strcmp(name, "auto"))
+		c = NULL;
+	else if(!strcmp(name, "table")) {
+		pthread_once(&crc_table_once, crc_table_setup);
+		c = &crc_impl_table;
+	}
+#if defined(__x86_64__)
+	else if(!strcmp(name, "sse42")) {
+		__builtin_cpu_init();
+		if(!__builtin_cpu_supports("sse4.2"))
+			return -1;
+		c = &crc_impl_sse42;
+	}
+#endif
+	else
+		return -1;
+
+	__atomic_store_n(&crc_selected, c, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+uint32_t
+rabbit_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	return ~crc_get()->update(~crc, buf, len);
+}
+
+/*
+ * Same steps as rabbit_crypt_stream: the leftover keystream, the whole
+ * blocks tile by tile, the last partial block into the context.
+*/
+uint32_t
+rabbit_crypt_stream_crc32c(struct rabbit_context *ctx, const uint8_t *buf, size_t buflen,
+	uint8_t *out, uint32_t crc, int decrypt)
+{
+	const struct rabbit_backend *b = rabbit_backend_get();
+	const struct crc_impl *c = crc_get();
+	uint8_t tile[RABBIT_TILE] __attribute__((aligned(64)));
+	size_t n;
+
+	crc = ~crc;
+
+	n = (buflen < ctx->nleft) ? buflen : ctx->nleft;
+	crc = c->xor(out, buf, ctx->leftover + 16 - ctx->nleft, n, crc, decrypt);
+	ctx->nleft -= n;
+	buflen -= n, buf += n, out += n;
+
+	while(buflen >= 16) {
+		n = (buflen < RABBIT_TILE) ? buflen & ~(size_t)15 : RABBIT_TILE;
+
+		b->keystream(ctx, tile, n / 16);
+		crc = c->xor(out, buf, tile, n, crc, decrypt);
+
+		buflen -= n, buf += n, out += n;
+	}
+
+	if(buflen) {
+		b->keystream(ctx, ctx->leftover, 1);
+		crc = c->xor(out, buf, ctx->leftover, buflen, crc, decrypt);
+		ctx->nleft = 16 - buflen;
+	}
+
+	rabbit_wipe(tile, sizeof(tile));
+
+	return ~crc;
+}
@@ -0,0 +1,46 @@
+/*
+ * CRC32C (Castagnoli) integrity check of the RABBIT-128 library.
+ * The backend generates the keystream into a tile that stays in L1,
+ * then one loop XORs the tile into the data and feeds every ciphertext
+ * word to the CRC from the register it was just computed (encrypt) or
+ * loaded (decrypt) in. The data is read and written once; the keystream
+ * makes one extra trip through L1, it is not CRCed inside the backend
+ * kernels.
+ * The CRC uses the SSE4.2 crc32 instruction when the CPU has it and a
+ * table otherwise. It detects corruption, it is not a MAC: use
+ * rabbit_aead.h against an attacker.
+*/
+
+#ifndef RABBIT_CRC32C_H
+#define RABBIT_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rabbit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Update a CRC32C with len bytes of buf.
+ * Start with crc = 0, pass the result of a call to the next one.
+*/
+uint32_t rabbit_crc32c(uint32_t crc, const void *buf, size_t len);
+
+/*
+ * rabbit_crypt_stream with the CRC32C of the ciphertext.
+ * crc - the CRC of the ciphertext so far (0 at the start)
+ * decrypt - 0: buf is the plaintext and the CRC is over out,
+ * 1: buf is the ciphertext and the CRC is over buf
+ * Returns the updated CRC. buf may be equal to out.
+*/
+uint32_t rabbit_crypt_stream_crc32c(struct rabbit_context *ctx, const uint8_t *buf, size_t buflen,
+	uint8_t *out, uint32_t crc, int decrypt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * SSE4.2 CRC32C of the RABBIT-128 library.
+ * The file is compiled with -msse4.2.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <nmmintrin.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+
+uint32_t
+rabbit_crc32c_sse42(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	uint64_t c = crc, w;
+
+	for(; len >= 8; len -= 8, buf += 8) {
+		memcpy(&w, buf, 8);
+		c = _mm_crc32_u64(c, w);
+	}
+
+	crc = c;
+	for(; len; len--, buf++)
+		crc = _mm_crc32_u8(crc, *buf);
+
+	return crc;
+}
+
+/*
+ * XOR of a keystream tile with the CRC of the ciphertext word by word:
+ * the CRC takes the word just stored when encrypting, the word just
+ * loaded when decrypting.
+*/
+uint32_t
+rabbit_crc32c_xor_sse42(uint8_t *out, const uint8_t *buf, const uint8_t *ks, size_t len,
+	uint32_t crc, int decrypt)
+{
+	uint64_t c = crc, w, k;
+
+	for(; len >= 8; len -= 8, buf += 8, ks += 8, out += 8) {
+		memcpy(&w, buf, 8);
+		memcpy(&k, ks, 8);
+		c = _mm_crc32_u64(c, decrypt ? w : w ^ k);
+		w ^= k;
+		memcpy(out, &w, 8);
+	}
+
+	crc = c;
+	for(; len; len--, buf++, ks++, out++) {
+		crc = _mm_crc32_u8(crc, decrypt ? *buf : *buf ^ *ks);
+		*out = *buf ^ *ks;
+	}
+
+	return crc;
+}
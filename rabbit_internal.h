@@ -0,0 +1,168 @@
+/* 
+ * Internal definitions of the RABBIT-128 library.
+ * Shared by the scalar code in rabbit.c and the SIMD kernels,
+ * not a part of the public interface.
+*/
+
+#ifndef RABBIT_INTERNAL_H
+#define RABBIT_INTERNAL_H
+
+#define RABBIT_ROTL32(v, n)	((v << n) | (v >> (32 - n)))
+
+// Selecting the byte order: __BYTE_ORDER__ is predefined by the compiler
+// in every language mode, strict -std=c11 included
+#if !defined(__BYTE_ORDER__)
+#error unknown byte order
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define RABBIT_U32TO32(x)								\
+	((x << 24) | ((x << 8) & 0xFF0000) | ((x >> 8) & 0xFF00) | (x >> 24))
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define RABBIT_U32TO32(x)	(x)
+#else
+#error unsuported byte order
+#endif
+
+#define RABBIT_U8TO32_LITTLE(p) 					  \
+	(((uint32_t)((p)[0])      ) | ((uint32_t)((p)[1]) << 8) | \
+	 ((uint32_t)((p)[2]) << 16) | ((uint32_t)((p)[3]) << 24))
+
+// G-func the RABBIT-128 algorithm. The upper 32 bits XOR the lower 32 bits
+// of the square, taken from one native 32x32->64 multiplication
+#define RABBIT_G_FUNC(x, y) {						  \
+	uint32_t u;						  \
+	uint64_t sq;						  \
+	u = x;							  \
+	sq = (uint64_t)u * u;					  \
+	y = (uint32_t)sq ^ (uint32_t)(sq >> 32);		  \
+}
+
+// Constant of the algorithm for the function rabbit_next_state 
+#define RABBIT_A0	0x4D34D34D
+#define RABBIT_A1	0xD34D34D3
+#define RABBIT_A2	0x34D34D34
+#define RABBIT_A3	RABBIT_A0
+#define RABBIT_A4	RABBIT_A1
+#define RABBIT_A5	RABBIT_A2
+#define RABBIT_A6	RABBIT_A0
+#define RABBIT_A7	RABBIT_A1
+
+/* 
+ * Eight RABBIT-128 contexts in the transposed (lane-per-context) layout.
+ * x[i][lane] - the state variable i of the context lane
+ * c[i][lane] - the counter i of the context lane
+ * carry[lane] - the counter carry bit of the context lane
+*/
+struct rabbit_x8 {
+	uint32_t x[8][8];
+	uint32_t c[8][8];
+	uint32_t carry[8];
+} __attribute__((aligned(32)));
+
+// Sixteen RABBIT-128 contexts in the same transposed layout
+struct rabbit_x16 {
+	uint32_t x[8][16];
+	uint32_t c[8][16];
+	uint32_t carry[16];
+} __attribute__((aligned(64)));
+
+// Start the work state from a master state
+static inline void
+rabbit_master_load(struct rabbit_context *ctx, const struct rabbit_master *master)
+{
+	memcpy(ctx->x, master->x, sizeof(ctx->x));
+	memcpy(ctx->c, master->c, sizeof(ctx->c));
+	ctx->carry = master->carry;
+}
+
+// Clear key material, the stores are not optimized away
+static inline void
+rabbit_wipe(void *p, size_t n)
+{
+	memset(p, 0, n);
+	__asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+// Keystream tile of the decoupled crypt, small enough to stay in L1
+#define RABBIT_TILE	1024
+
+/* 
+ * RABBIT-128 backend.
+ * name - the name used by RABBIT_BACKEND and rabbit_backend_select
+ * supported - returns 1 if the CPU can run the backend
+ * crypt - the rabbit_crypt implementation
+ * keystream - generate nblocks keystream blocks into a 64-byte aligned tile
+ * skip - advance the state by nblocks blocks, no output
+ * xor_tile - XOR a tile into the data, nt selects non-temporal stores
+ * lanes - contexts per call of the multi-stream entries (1 - none)
+ * setup_lanes - key and IV setup of lanes contexts at once
+ * packet_lanes - IV setup of lanes packets from one master state and their crypt
+*/
+struct rabbit_backend {
+	const char *name;
+	int (*supported)(void);
+	void (*crypt)(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+	void (*keystream)(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks);
+	void (*skip)(struct rabbit_context *ctx, uint64_t nblocks);
+	void (*xor_tile)(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt);
+	int lanes;
+	void (*setup_lanes)(struct rabbit_context **ctx, const uint8_t **key, const uint8_t **iv);
+	void (*packet_lanes)(const struct rabbit_master *master, const uint8_t **iv,
+		const uint8_t **buf, const uint32_t *buflen, uint8_t **out);
+};
+
+const struct rabbit_backend *rabbit_backend_get(void);
+
+void rabbit_crypt_scalar(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+void rabbit_crypt_sse2(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+void rabbit_crypt_avx2(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+void rabbit_crypt_avx512(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+
+void rabbit_keystream_scalar(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks);
+void rabbit_keystream_sse2(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks);
+void rabbit_keystream_avx2(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks);
+void rabbit_keystream_avx512(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks);
+
+void rabbit_skip_scalar(struct rabbit_context *ctx, uint64_t nblocks);
+void rabbit_skip_sse2(struct rabbit_context *ctx, uint64_t nblocks);
+void rabbit_skip_avx2(struct rabbit_context *ctx, uint64_t nblocks);
+void rabbit_skip_avx512(struct rabbit_context *ctx, uint64_t nblocks);
+
+void rabbit_xor_scalar(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt);
+void rabbit_xor_sse2(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt);
+void rabbit_xor_avx2(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt);
+void rabbit_xor_avx512(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt);
+
+void rabbit_x8_key_setup(struct rabbit_x8 *st, const uint8_t *key[8]);
+void rabbit_x8_iv_setup(struct rabbit_x8 *st, const uint8_t *iv[8]);
+void rabbit_x16_key_setup(struct rabbit_x16 *st, const uint8_t *key[16]);
+void rabbit_x16_iv_setup(struct rabbit_x16 *st, const uint8_t *iv[16]);
+
+// Crypt of nblocks blocks in each of the eight lanes of a transposed state (AVX2)
+void rabbit_x8_crypt_blocks(struct rabbit_x8 *st, const uint8_t *buf[8], uint8_t *out[8], uint32_t nblocks);
+
+// Crypt of the sixteen lanes of a transposed state in place (AVX-512)
+void rabbit_x16_crypt(struct rabbit_x16 *st, const uint8_t *buf[16], const uint32_t buflen[16], uint8_t *out[16]);
+
+void rabbit_setup_x8(struct rabbit_context **ctx, const uint8_t **key, const uint8_t **iv);
+void rabbit_setup_x16(struct rabbit_context **ctx, const uint8_t **key, const uint8_t **iv);
+
+// CRC32C with the SSE4.2 instruction, see rabbit_crc32c.c
+uint32_t rabbit_crc32c_sse42(uint32_t crc, const uint8_t *buf, size_t len);
+uint32_t rabbit_crc32c_xor_sse42(uint8_t *out, const uint8_t *buf, const uint8_t *ks, size_t len,
+	uint32_t crc, int decrypt);
+
+// Threshold of the tiled path of rabbit_crypt for the tests, 0 for the LLC size
+void rabbit_llc_set(uint64_t size);
+
+// CRC32C implementation for the tests, 0 or -1 if unknown or unsupported
+int rabbit_crc32c_select(const char *name);
+
+// One-shot Poly1305 of the AEAD, see rabbit_aead.c
+void rabbit_poly1305(uint8_t tag[16], const uint8_t key[32], const uint8_t *m, size_t len);
+
+void rabbit_packets_x8(const struct rabbit_master *master, const uint8_t **iv,
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out);
+void rabbit_packets_x16(const struct rabbit_master *master, const uint8_t **iv,
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out);
+
+#endif
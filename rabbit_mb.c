@@ -0,0 +1,345 @@
+/*
+ * Multi-buffer job manager of the RABBIT-128 library.
+ * A run takes L, the smallest remaining length of the busy lanes. The
+ * lanes that have exactly L bytes left finish their job, the others
+ * advance by the whole blocks of L and keep their state in the lane.
+ * With AVX-512 the masked sixteen-lane kernel does both at once; with
+ * AVX2 the free lanes run on a scratch buffer and the last partial
+ * block of a finishing job is done by rabbit_crypt. Without SIMD lanes
+ * every job is done at submit.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_mb.h"
+
+// Scratch of the free AVX2 lanes, the runs are cut to its size
+#define SCRATCH_BLOCKS	64
+
+// Completed jobs waiting to be returned, at most one per lane
+#define COMPLETED	16
+
+struct rabbit_mb_mgr {
+	union {
+		struct rabbit_x8 x8;
+		struct rabbit_x16 x16;
+	} st;
+	uint8_t scratch[SCRATCH_BLOCKS * 16] __attribute__((aligned(64)));
+
+	// The rows of the state in use, lanes words each
+	uint32_t *x, *c, *carry;
+
+	int lanes;
+	int busy;
+	struct rabbit_job *job[16];	// NULL - free lane
+	uint32_t done[16];		// bytes of the job done
+	uint64_t parked[16];		// the time the job entered the lane
+
+	struct rabbit_job *completed[COMPLETED];
+	int first, ncompleted;
+
+	uint64_t max_delay;
+};
+
+static uint64_t
+mb_now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// Copy the state of a context into a lane
+static void
+mb_lane_load(struct rabbit_mb_mgr *m, int lane, const struct rabbit_context *ctx)
+{
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		m->x[i * m->lanes + lane] = ctx->x[i];
+		m->c[i * m->lanes + lane] = ctx->c[i];
+	}
+	m->carry[lane] = ctx->carry;
+}
+
+// Copy a lane back into its context
+static void
+mb_lane_store(const struct rabbit_mb_mgr *m, int lane, struct rabbit_context *ctx)
+{
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		ctx->x[i] = m->x[i * m->lanes + lane];
+		ctx->c[i] = m->c[i * m->lanes + lane];
+	}
+	ctx->carry = m->carry[lane];
+}
+
+static void
+mb_complete(struct rabbit_mb_mgr *m, struct rabbit_job *job)
+{
+	job->status = RABBIT_JOB_DONE;
+	m->completed[(m->first + m->ncompleted) % COMPLETED] = job;
+	m->ncompleted++;
+}
+
+// Release a lane whose job is done
+static void
+mb_lane_finish(struct rabbit_mb_mgr *m, int lane)
+{
+	mb_lane_store(m, lane, m->job[lane]->ctx);
+	mb_complete(m, m->job[lane]);
+	m->job[lane] = NULL;
+	m->busy--;
+}
+
+// The AVX2 run: L / 16 blocks in all lanes, then the tails of the finishing jobs
+static void
+mb_run_x8(struct rabbit_mb_mgr *m, uint32_t len)
+{
+	const uint8_t *buf[8];
+	uint8_t *out[8];
+	struct rabbit_job *job;
+	uint32_t nblocks, n, off;
+	int lane;
+
+	nblocks = len / 16;
+
+	for(off = 0; nblocks; nblocks -= n, off += n * 16) {
+		// With free lanes the run is cut to the scratch size
+		n = (m->busy == 8 || nblocks < SCRATCH_BLOCKS) ? nblocks : SCRATCH_BLOCKS;
+
+		for(lane = 0; lane < 8; lane++) {
+			if((job = m->job[lane]) != NULL) {
+				buf[lane] = job->buf + m->done[lane] + off;
+				out[lane] = job->out + m->done[lane] + off;
+			} else {
+				buf[lane] = m->scratch;
+				out[lane] = m->scratch;
+			}
+		}
+
+		rabbit_x8_crypt_blocks(&m->st.x8, buf, out, n);
+	}
+
+	for(lane = 0; lane < 8; lane++) {
+		if((job = m->job[lane]) == NULL)
+			continue;
+
+		m->done[lane] += len & ~15U;
+
+		if(job->buflen - m->done[lane] == (len & 15)) {
+			mb_lane_store(m, lane, job->ctx);
+			rabbit_crypt(job->ctx, job->buf + m->done[lane], len & 15, job->out + m->done[lane]);
+			mb_complete(m, job);
+			m->job[lane] = NULL;
+			m->busy--;
+		}
+	}
+}
+
+// The AVX-512 run: the finishing lanes do L bytes, the others its whole blocks
+static void
+mb_run_x16(struct rabbit_mb_mgr *m, uint32_t len)
+{
+	const uint8_t *buf[16];
+	uint8_t *out[16];
+	uint32_t buflen[16];
+	struct rabbit_job *job;
+	int lane;
+
+	for(lane = 0; lane < 16; lane++) {
+		if((job = m->job[lane]) != NULL) {
+			buf[lane] = job->buf + m->done[lane];
+			out[lane] = job->out + m->done[lane];
+			buflen[lane] = (job->buflen - m->done[lane] == len) ? len : len & ~15U;
+		} else {
+			buf[lane] = m->scratch;
+			out[lane] = m->scratch;
+			buflen[lane] = 0;
+		}
+	}
+
+	rabbit_x16_crypt(&m->st.x16, buf, buflen, out);
+
+	for(lane = 0; lane < 16; lane++) {
+		if(m->job[lane] == NULL)
+			continue;
+
+		m->done[lane] += buflen[lane];
+		if(m->done[lane] == m->job[lane]->buflen)
+			mb_lane_finish(m, lane);
+	}
+}
+
+// One kernel run over the busy lanes, at least one job completes
+static void
+mb_run(struct rabbit_mb_mgr *m)
+{
+	uint32_t len = UINT32_MAX, rem;
+	int lane;
+
+	if(m->busy == 0)
+		return;
+
+	for(lane = 0; lane < m->lanes; lane++) {
+		if(m->job[lane] == NULL)
+			continue;
+
+		rem = m->job[lane]->buflen - m->done[lane];
+		if(rem < len)
+			len = rem;
+	}
+
+	if(m->lanes == 16)
+		mb_run_x16(m, len);
+	else
+		mb_run_x8(m, len);
+}
+
+// A parked job has waited for max_delay or longer
+static int
+mb_due(const struct rabbit_mb_mgr *m, uint64_t now)
+{
+	int lane;
+
+	for(lane = 0; lane < m->lanes; lane++) {
+		if(m->job[lane] != NULL && now - m->parked[lane] >= m->max_delay)
+			return 1;
+	}
+
+	return 0;
+}
+
+struct rabbit_mb_mgr *
+rabbit_mb_new(uint64_t max_delay_ns)
+{
+	struct rabbit_mb_mgr *m;
+
+	m = aligned_alloc(64, (sizeof(*m) + 63) & ~(size_t)63);
+	if(m == NULL)
+		return NULL;
+
+	memset(m, 0, sizeof(*m));
+	m->lanes = rabbit_backend_get()->lanes;
+
+	if(m->lanes == 16) {
+		m->x = &m->st.x16.x[0][0];
+		m->c = &m->st.x16.c[0][0];
+		m->carry = m->st.x16.carry;
+	} else {
+		m->x = &m->st.x8.x[0][0];
+		m->c = &m->st.x8.c[0][0];
+		m->carry = m->st.x8.carry;
+	}
+	m->max_delay = max_delay_ns;
+
+	return m;
+}
+
+void
+rabbit_mb_free(struct rabbit_mb_mgr *m)
+{
+	if(m != NULL)
+		rabbit_wipe(m, sizeof(*m));
+	free(m);
+}
+
+struct rabbit_job *
+rabbit_mb_get_completed(struct rabbit_mb_mgr *m)
+{
+	struct rabbit_job *job;
+
+	if(m->ncompleted == 0)
+		return NULL;
+
+	job = m->completed[m->first];
+	m->first = (m->first + 1) % COMPLETED;
+	m->ncompleted--;
+
+	return job;
+}
+
+/*
+ * A run only finishes the shortest jobs, so the runs go on until no
+ * parked job is overdue. The completed queue has room for all of them.
+*/
+struct rabbit_job *
+rabbit_mb_poll(struct rabbit_mb_mgr *m)
+{
+	uint64_t now;
+
+	if(m->busy && m->max_delay) {
+		now = mb_now();
+		while(mb_due(m, now))
+			mb_run(m);
+	}
+
+	return rabbit_mb_get_completed(m);
+}
+
+struct rabbit_job *
+rabbit_mb_submit(struct rabbit_mb_mgr *m, struct rabbit_job *job)
+{
+	int lane, free_lane = -1;
+
+	job->status = RABBIT_JOB_PENDING;
+
+	// No lanes, or nothing to do: the job is done right away
+	if(m->lanes <= 1 || job->buflen == 0) {
+		rabbit_crypt(job->ctx, job->buf, job->buflen, job->out);
+		mb_complete(m, job);
+		return rabbit_mb_get_completed(m);
+	}
+
+	// The previous job of the same context goes first
+	for(lane = 0; lane < m->lanes; lane++) {
+		while(m->job[lane] != NULL && m->job[lane]->ctx == job->ctx)
+			mb_run(m);
+	}
+
+	// The completed queue holds one job per lane, make room
+	while(m->ncompleted + m->busy >= COMPLETED && m->busy)
+		mb_run(m);
+
+	for(lane = 0; lane < m->lanes; lane++) {
+		if(m->job[lane] == NULL) {
+			free_lane = lane;
+			break;
+		}
+	}
+
+	mb_lane_load(m, free_lane, job->ctx);
+	m->job[free_lane] = job;
+	m->done[free_lane] = 0;
+	m->parked[free_lane] = m->max_delay ? mb_now() : 0;
+	m->busy++;
+
+	if(m->busy == m->lanes)
+		mb_run(m);
+
+	return rabbit_mb_poll(m);
+}
+
+struct rabbit_job *
+rabbit_mb_flush(struct rabbit_mb_mgr *m)
+{
+	if(m->ncompleted == 0)
+		mb_run(m);
+
+	return rabbit_mb_get_completed(m);
+}
+
+int
+rabbit_mb_in_flight(const struct rabbit_mb_mgr *m)
+{
+	return m->busy;
+}
@@ -0,0 +1,82 @@
+/*
+ * Multi-buffer job manager of the RABBIT-128 library.
+ * Jobs arrive one at a time and are parked in the SIMD lanes of the
+ * backend (8 with AVX2, 16 with AVX-512). The vector kernel runs once
+ * all lanes are taken, so irregular traffic still gets the multi-stream
+ * throughput. The lane states stay transposed in the manager between
+ * runs, a context is only loaded when its job enters a lane and stored
+ * back when the job leaves it.
+*/
+
+#ifndef RABBIT_MB_H
+#define RABBIT_MB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rabbit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RABBIT_JOB_PENDING	0
+#define RABBIT_JOB_DONE		1
+
+/*
+ * RABBIT crypt job: rabbit_crypt(ctx, buf, buflen, out) done later.
+ * user - free for the caller
+ * status - RABBIT_JOB_PENDING while in the manager, then RABBIT_JOB_DONE
+ * The job, the context and the buffers must stay valid and untouched
+ * until the manager returns the job.
+*/
+struct rabbit_job {
+	struct rabbit_context *ctx;
+	const uint8_t *buf;
+	uint32_t buflen;
+	uint8_t *out;
+	void *user;
+	int status;
+};
+
+struct rabbit_mb_mgr;
+
+/*
+ * New manager on the lanes of the current backend.
+ * max_delay_ns - latency bound: a job that waits longer for its lane
+ * group to fill up is forced out by the next submit or poll (0 - none)
+ * NULL if out of memory.
+*/
+struct rabbit_mb_mgr *rabbit_mb_new(uint64_t max_delay_ns);
+
+// Jobs still in the manager are not completed
+void rabbit_mb_free(struct rabbit_mb_mgr *m);
+
+/*
+ * Park a job in a free lane. The kernel runs when all lanes are taken.
+ * Returns a completed job (not always the one submitted), or NULL.
+ * Jobs on a context that already has a job in flight wait for it.
+*/
+struct rabbit_job *rabbit_mb_submit(struct rabbit_mb_mgr *m, struct rabbit_job *job);
+
+// A completed job not yet returned, or NULL. No kernel run.
+struct rabbit_job *rabbit_mb_get_completed(struct rabbit_mb_mgr *m);
+
+// Check the latency bound: run the partial batch until no job is overdue.
+// Returns a completed job or NULL.
+struct rabbit_job *rabbit_mb_poll(struct rabbit_mb_mgr *m);
+
+/*
+ * Run the partial batch until a job completes and return it.
+ * NULL once the manager is empty: call it in a loop to drain.
+*/
+struct rabbit_job *rabbit_mb_flush(struct rabbit_mb_mgr *m);
+
+// Jobs in the lanes
+int rabbit_mb_in_flight(const struct rabbit_mb_mgr *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
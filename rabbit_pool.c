@@ -0,0 +1,276 @@
+/*
+ * Thread pool of the RABBIT-128 library.
+ * The jobs of a batch are ordered by size class (the bit length of
+ * buflen), largest first, with a counting sort, and dealt round-robin:
+ * job k of the order goes to deque k % nthreads. A deque is a range of
+ * positions in that order, head and tail packed in one 64-bit word and
+ * moved with a CAS. The owner takes from the head (its largest job),
+ * a thief from the tail (the smallest one). Nothing is pushed during a
+ * batch, so a thread that finds all the deques empty is done.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rabbit.h"
+#include "rabbit_pool.h"
+
+// Jobs per run of a batch, the deque positions are 32-bit
+#define POOL_WINDOW	((size_t)1 << 30)
+
+// Size classes: 0 for an empty job, else the bit length of buflen
+#define CLASSES		65
+
+// Deque of a thread, on its own cache line
+struct pool_deque {
+	uint64_t range;			// head (low word), tail (high word)
+	struct rabbit_pool *pool;
+} __attribute__((aligned(64)));
+
+struct rabbit_pool {
+	int nthreads;
+	int nstarted;
+	pthread_t *thread;
+	struct pool_deque *deque;	// deque[0] is the calling thread's
+
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	unsigned long generation;
+	int active;			// threads still on the batch
+	int stop;
+
+	// The batch
+	const struct rabbit_pool_job *jobs;
+	uint32_t *order;
+	size_t norder;
+};
+
+static inline void
+pool_run(const struct rabbit_pool_job *j)
+{
+	rabbit_crypt(j->ctx, j->buf, j->buflen, j->out);
+}
+
+static inline int
+pool_class(size_t len)
+{
+	return len ? 64 - __builtin_clzll(len) : 0;
+}
+
+// Order the jobs largest size class first, -1 if out of memory
+static int
+pool_order(struct rabbit_pool *p, const struct rabbit_pool_job *jobs, size_t n)
+{
+	size_t count[CLASSES] = { 0 }, pos, t;
+	uint32_t *order;
+	size_t i;
+	int c;
+
+	if(n > p->norder) {
+		order = realloc(p->order, n * sizeof(*order));
+		if(order == NULL)
+			return -1;
+		p->order = order;
+		p->norder = n;
+	}
+
+	for(i = 0; i < n; i++)
+		count[pool_class(jobs[i].buflen)]++;
+
+	for(pos = 0, c = CLASSES - 1; c >= 0; c--) {
+		t = count[c];
+		count[c] = pos;
+		pos += t;
+	}
+
+	for(i = 0; i < n; i++)
+		p->order[count[pool_class(jobs[i].buflen)]++] = i;
+
+	return 0;
+}
+
+// Take a position from the head (owner) or the tail (thief) of a deque
+static inline int
+pool_take(struct pool_deque *d, int steal, uint32_t *pos)
+{
+	uint64_t r, nr;
+	uint32_t head, tail;
+
+	r = __atomic_load_n(&d->range, __ATOMIC_RELAXED);
+	do {
+		head = r;
+		tail = r >> 32;
+		if(head >= tail)
+			return 0;
+
+		if(steal) {
+			*pos = tail - 1;
+			nr = r - ((uint64_t)1 << 32);
+		} else {
+			*pos = head;
+			nr = r + 1;
+		}
+	} while(!__atomic_compare_exchange_n(&d->range, &r, nr, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	return 1;
+}
+
+// Own deque first, then steal from the others in turn
+static void
+pool_work(struct rabbit_pool *p, int w)
+{
+	int t = p->nthreads, i, v;
+	uint32_t pos;
+
+	while(pool_take(&p->deque[w], 0, &pos))
+		pool_run(&p->jobs[p->order[(size_t)pos * t + w]]);
+
+	for(i = 1; i < t; i++) {
+		v = (w + i) % t;
+		while(pool_take(&p->deque[v], 1, &pos))
+			pool_run(&p->jobs[p->order[(size_t)pos * t + v]]);
+	}
+}
+
+static void *
+pool_thread(void *arg)
+{
+	struct pool_deque *d = arg;
+	struct rabbit_pool *p = d->pool;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&p->lock);
+	for(;;) {
+		while(p->generation == seen && !p->stop)
+			pthread_cond_wait(&p->start, &p->lock);
+		if(p->stop)
+			break;
+		seen = p->generation;
+		pthread_mutex_unlock(&p->lock);
+
+		pool_work(p, d - p->deque);
+
+		pthread_mutex_lock(&p->lock);
+		if(--p->active == 0)
+			pthread_cond_signal(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+struct rabbit_pool *
+rabbit_pool_new(int nthreads)
+{
+	struct rabbit_pool *p;
+	int i;
+
+	if(nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthreads <= 0)
+		nthreads = 1;
+
+	if((p = calloc(1, sizeof(*p))) == NULL)
+		return NULL;
+
+	p->nthreads = nthreads;
+	p->thread = malloc(nthreads * sizeof(*p->thread));
+	p->deque = aligned_alloc(64, nthreads * sizeof(*p->deque));
+	if(p->thread == NULL || p->deque == NULL) {
+		free(p->thread);
+		free(p->deque);
+		free(p);
+		return NULL;
+	}
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->start, NULL);
+	pthread_cond_init(&p->done, NULL);
+
+	for(i = 0; i < nthreads; i++) {
+		p->deque[i].range = 0;
+		p->deque[i].pool = p;
+	}
+
+	for(i = 1; i < nthreads; i++) {
+		if(pthread_create(&p->thread[i], NULL, pool_thread, &p->deque[i])) {
+			rabbit_pool_free(p);
+			return NULL;
+		}
+		p->nstarted = i;
+	}
+
+	return p;
+}
+
+void
+rabbit_pool_free(struct rabbit_pool *p)
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->lock);
+
+	for(i = 1; i <= p->nstarted; i++)
+		pthread_join(p->thread[i], NULL);
+
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->start);
+	pthread_cond_destroy(&p->done);
+
+	free(p->order);
+	free(p->thread);
+	free(p->deque);
+	free(p);
+}
+
+int
+rabbit_pool_threads(const struct rabbit_pool *p)
+{
+	return p->nthreads;
+}
+
+/*
+ * RABBIT crypt of a batch on the pool.
+ * The calling thread works on deque 0 and waits for the other threads
+ * to leave the batch before the next window or the return.
+*/
+void
+rabbit_pool_crypt(struct rabbit_pool *p, const struct rabbit_pool_job *jobs, size_t n)
+{
+	int t = p->nthreads, i;
+	size_t k, j;
+
+	for(; n; n -= k, jobs += k) {
+		k = (n < POOL_WINDOW) ? n : POOL_WINDOW;
+
+		if(t == 1 || pool_order(p, jobs, k)) {
+			for(j = 0; j < k; j++)
+				pool_run(&jobs[j]);
+			continue;
+		}
+
+		for(i = 0; i < t; i++)
+			p->deque[i].range = (k > (size_t)i) ? (uint64_t)((k - i + t - 1) / t) << 32 : 0;
+
+		pthread_mutex_lock(&p->lock);
+		p->jobs = jobs;
+		p->generation++;
+		p->active = t - 1;
+		pthread_cond_broadcast(&p->start);
+		pthread_mutex_unlock(&p->lock);
+
+		pool_work(p, 0);
+
+		pthread_mutex_lock(&p->lock);
+		while(p->active)
+			pthread_cond_wait(&p->done, &p->lock);
+		pthread_mutex_unlock(&p->lock);
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ * Thread pool of the RABBIT-128 library.
+ * A batch of independent crypt jobs, each on its own context, is spread
+ * over the threads of the pool. Every thread has a deque of jobs and
+ * steals from the others once its own deque is empty. The jobs are
+ * dealt largest first, so a long job never starts behind the small ones.
+ * A job is never cut: the second half of a stream needs the state at
+ * its start, and Rabbit only gets there by running the first half.
+ * rabbit_skip does that without the output, but it is no shortcut:
+ * the state x has no jump-ahead, and a skip costs 81-87% of a crypt
+ * of the same length on every backend (16 MiB, 1-CPU Xeon VM). A job
+ * cut in k chunks would end at most 1.2 times sooner, the last chunk
+ * still skipping over all the others, while the skips add about k/2
+ * times the work of the job.
+*/
+
+#ifndef RABBIT_POOL_H
+#define RABBIT_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rabbit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * RABBIT pool job: rabbit_crypt(ctx, buf, buflen, out).
+ * The contexts of the jobs of a batch must be different.
+*/
+struct rabbit_pool_job {
+	struct rabbit_context *ctx;
+	const uint8_t *buf;
+	size_t buflen;
+	uint8_t *out;
+};
+
+struct rabbit_pool;
+
+/*
+ * New pool of nthreads threads, the calling thread of rabbit_pool_crypt
+ * being one of them (0 - one per online CPU).
+ * NULL if out of memory or the threads cannot be started.
+*/
+struct rabbit_pool *rabbit_pool_new(int nthreads);
+
+void rabbit_pool_free(struct rabbit_pool *p);
+
+int rabbit_pool_threads(const struct rabbit_pool *p);
+
+/*
+ * Run n jobs on the pool and return once all of them are done.
+ * One batch at a time per pool. If the job order cannot be allocated,
+ * the jobs are done on the calling thread.
+*/
+void rabbit_pool_crypt(struct rabbit_pool *p, const struct rabbit_pool_job *jobs, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
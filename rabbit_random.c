@@ -0,0 +1,340 @@
+/*
+ * Pseudo-random generator of the RABBIT-128 library.
+ * The thread generators live in thread-local storage. A fork bumps a
+ * global generation, a thread generator seeded in an older generation
+ * is seeded again, so the parent and the child never share a stream.
+ * A thread-specific key with a destructor wipes the thread generator
+ * when its thread exits.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_random.h"
+
+// Words converted per batch of the typed generators
+#define BATCH	256
+
+static __thread struct rabbit_rng tls_rng;
+static __thread unsigned long tls_generation;
+
+static unsigned long generation = 1;
+static pthread_once_t random_once = PTHREAD_ONCE_INIT;
+static pthread_key_t random_key;
+static int random_key_ok;
+
+static void
+random_atfork_child(void)
+{
+	__atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+}
+
+// Thread exit: wipe the generator, a later call in a destructor seeds it again
+static void
+random_thread_exit(void *rng)
+{
+	rabbit_rng_wipe(rng);
+	tls_generation = 0;
+}
+
+static void
+random_setup(void)
+{
+	pthread_atfork(NULL, NULL, random_atfork_child);
+	random_key_ok = !pthread_key_create(&random_key, random_thread_exit);
+}
+
+void
+rabbit_rng_init(struct rabbit_rng *rng, const uint8_t key[16], const uint8_t iv[8])
+{
+	rabbit_key_setup(&rng->master, key, 16);
+	rabbit_iv_setup(&rng->ctx, &rng->master, iv, 8);
+	rng->npool = 0;
+}
+
+int
+rabbit_rng_seed(struct rabbit_rng *rng)
+{
+	uint8_t seed[24];
+	size_t n = 0;
+	ssize_t r;
+
+	while(n < sizeof(seed)) {
+		r = getrandom(seed + n, sizeof(seed) - n, 0);
+		if(r < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		n += r;
+	}
+
+	rabbit_rng_init(rng, seed, seed + 16);
+	rabbit_wipe(seed, sizeof(seed));
+
+	return 0;
+}
+
+/*
+ * The pool goes first, whole pools are generated straight into out,
+ * the rest comes from a new pool.
+*/
+void
+rabbit_rng_bytes(struct rabbit_rng *rng, void *out, size_t len)
+{
+	uint8_t *p = out;
+	size_t n;
+
+	n = (len < rng->npool) ? len : rng->npool;
+	memcpy(p, rng->pool + RABBIT_RNG_POOL - rng->npool, n);
+	rng->npool -= n;
+	p += n, len -= n;
+
+	if(len >= RABBIT_RNG_POOL) {
+		n = len & ~(size_t)15;
+		rabbit_keystream(&rng->ctx, p, n);
+		p += n, len -= n;
+	}
+
+	if(len) {
+		rabbit_keystream(&rng->ctx, rng->pool, RABBIT_RNG_POOL);
+		memcpy(p, rng->pool, len);
+		rng->npool = RABBIT_RNG_POOL - len;
+	}
+}
+
+void
+rabbit_rng_wipe(struct rabbit_rng *rng)
+{
+	rabbit_wipe(rng, sizeof(*rng));
+}
+
+void
+rabbit_rng_substream(struct rabbit_rng *rng, const struct rabbit_rng *base, uint64_t id)
+{
+	uint8_t iv[8];
+	int i;
+
+	for(i = 0; i < 8; i++)
+		iv[i] = id >> (8 * i);
+
+	rng->master = base->master;
+	rabbit_iv_setup(&rng->ctx, &rng->master, iv, 8);
+	rng->npool = 0;
+}
+
+uint32_t
+rabbit_rng_u32(struct rabbit_rng *rng)
+{
+	uint32_t v;
+
+	rabbit_rng_bytes(rng, &v, sizeof(v));
+
+	return v;
+}
+
+uint64_t
+rabbit_rng_u64(struct rabbit_rng *rng)
+{
+	uint64_t v;
+
+	rabbit_rng_bytes(rng, &v, sizeof(v));
+
+	return v;
+}
+
+void
+rabbit_rng_float(struct rabbit_rng *rng, float *out, size_t n)
+{
+	uint32_t w[BATCH] __attribute__((aligned(64)));
+	size_t i, k;
+
+	for(; n; n -= k, out += k) {
+		k = (n < BATCH) ? n : BATCH;
+		rabbit_rng_bytes(rng, w, k * sizeof(w[0]));
+
+		for(i = 0; i < k; i++)
+			out[i] = (float)(w[i] >> 8) * 0x1p-24f;
+	}
+}
+
+void
+rabbit_rng_double(struct rabbit_rng *rng, double *out, size_t n)
+{
+	uint64_t w[BATCH] __attribute__((aligned(64)));
+	size_t i, k;
+
+	for(; n; n -= k, out += k) {
+		k = (n < BATCH) ? n : BATCH;
+		rabbit_rng_bytes(rng, w, k * sizeof(w[0]));
+
+		for(i = 0; i < k; i++)
+			out[i] = (double)(w[i] >> 11) * 0x1p-53;
+	}
+}
+
+/*
+ * The high word of x * bound is uniform on [0, bound) unless the low
+ * word falls under 2^32 mod bound, then x is drawn again. That
+ * threshold is below bound, so the division is only done when the low
+ * word is under bound, with probability bound / 2^32.
+*/
+void
+rabbit_rng_bounded(struct rabbit_rng *rng, uint32_t *out, size_t n, uint32_t bound)
+{
+	uint32_t w[BATCH] __attribute__((aligned(64))), t;
+	uint64_t m;
+	size_t i, k;
+
+	if(bound == 0) {
+		rabbit_rng_bytes(rng, out, n * sizeof(out[0]));
+		return;
+	}
+
+	for(; n; n -= k, out += k) {
+		k = (n < BATCH) ? n : BATCH;
+		rabbit_rng_bytes(rng, w, k * sizeof(w[0]));
+
+		for(i = 0; i < k; i++) {
+			m = (uint64_t)w[i] * bound;
+			if((uint32_t)m < bound) {
+				t = -bound % bound;
+				while((uint32_t)m < t)
+					m = (uint64_t)rabbit_rng_u32(rng) * bound;
+			}
+			out[i] = m >> 32;
+		}
+	}
+}
+
+/*
+ * Ziggurat of Marsaglia and Tsang, 128 layers of equal area under the
+ * normal density. A draw takes the layer from the low 7 bits of a word
+ * and a signed 32-bit x from its high half; x falls inside the layer
+ * rectangle in about 99% of the cases and is returned as it is. The
+ * edges and the tail beyond R are resolved with more draws.
+*/
+#define ZIG_R	3.442619855899
+#define ZIG_V	9.91256303526217e-3
+
+static uint32_t zig_k[128];
+static double zig_w[128], zig_f[128];
+static pthread_once_t zig_once = PTHREAD_ONCE_INIT;
+
+static void
+zig_setup(void)
+{
+	double dn = ZIG_R, tn = ZIG_R, q;
+	int i;
+
+	q = ZIG_V / exp(-0.5 * dn * dn);
+
+	zig_k[0] = (dn / q) * 2147483648.0;
+	zig_k[1] = 0;
+	zig_w[0] = q / 2147483648.0;
+	zig_w[127] = dn / 2147483648.0;
+	zig_f[0] = 1.0;
+	zig_f[127] = exp(-0.5 * dn * dn);
+
+	for(i = 126; i >= 1; i--) {
+		dn = sqrt(-2.0 * log(ZIG_V / dn + exp(-0.5 * dn * dn)));
+		zig_k[i + 1] = (dn / tn) * 2147483648.0;
+		tn = dn;
+		zig_f[i] = exp(-0.5 * dn * dn);
+		zig_w[i] = dn / 2147483648.0;
+	}
+}
+
+// Uniform on (0, 1), for the logs of the slow path
+static inline double
+zig_uniform(struct rabbit_rng *rng)
+{
+	return ((double)(rabbit_rng_u64(rng) >> 11) + 0.5) * 0x1p-53;
+}
+
+// The slow path: x outside the rectangle of layer i
+static double
+zig_fix(struct rabbit_rng *rng, uint64_t w)
+{
+	int32_t hz;
+	uint32_t i;
+	double x, y;
+
+	for(;;) {
+		hz = (int32_t)(w >> 32);
+		i = w & 127;
+		x = hz * zig_w[i];
+
+		if((uint32_t)(hz < 0 ? -(int64_t)hz : hz) < zig_k[i])
+			return x;
+
+		if(i == 0) {
+			// The tail beyond R
+			do {
+				x = -log(zig_uniform(rng)) / ZIG_R;
+				y = -log(zig_uniform(rng));
+			} while(y + y < x * x);
+
+			return (hz > 0) ? ZIG_R + x : -ZIG_R - x;
+		}
+
+		if(zig_f[i] + zig_uniform(rng) * (zig_f[i - 1] - zig_f[i]) < exp(-0.5 * x * x))
+			return x;
+
+		w = rabbit_rng_u64(rng);
+	}
+}
+
+void
+rabbit_rng_normal(struct rabbit_rng *rng, double *out, size_t n, double mean, double stddev)
+{
+	uint64_t w[BATCH] __attribute__((aligned(64)));
+	int32_t hz;
+	uint32_t i;
+	size_t j, k;
+
+	pthread_once(&zig_once, zig_setup);
+
+	for(; n; n -= k, out += k) {
+		k = (n < BATCH) ? n : BATCH;
+		rabbit_rng_bytes(rng, w, k * sizeof(w[0]));
+
+		for(j = 0; j < k; j++) {
+			hz = (int32_t)(w[j] >> 32);
+			i = w[j] & 127;
+
+			if((uint32_t)(hz < 0 ? -(int64_t)hz : hz) < zig_k[i])
+				out[j] = mean + stddev * (hz * zig_w[i]);
+			else
+				out[j] = mean + stddev * zig_fix(rng, w[j]);
+		}
+	}
+}
+
+int
+rabbit_random(void *out, size_t len)
+{
+	unsigned long g;
+
+	g = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+	if(tls_generation != g) {
+		pthread_once(&random_once, random_setup);
+		if(!random_key_ok || pthread_setspecific(random_key, &tls_rng))
+			return -1;
+		if(rabbit_rng_seed(&tls_rng))
+			return -1;
+		tls_generation = g;
+	}
+
+	rabbit_rng_bytes(&tls_rng, out, len);
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Pseudo-random generator of the RABBIT-128 library.
+ * The output is the raw keystream of one (key, IV) stream, taken from a
+ * pool of one tile, so small requests do not pay for a backend call and
+ * large ones are generated straight into the destination. The bytes
+ * come out in keystream order whatever the sizes of the requests.
+*/
+
+#ifndef RABBIT_RANDOM_H
+#define RABBIT_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rabbit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RABBIT_RNG_POOL	1024
+
+/*
+ * Generator state.
+ * ctx - the keystream generator
+ * pool - keystream not given out yet, npool bytes at its end
+*/
+struct rabbit_rng {
+	struct rabbit_context ctx;
+	struct rabbit_master master;	// key schedule, for substreams
+	uint8_t pool[RABBIT_RNG_POOL] __attribute__((aligned(64)));
+	uint32_t npool;
+};
+
+// Deterministic generator: the keystream of key and iv
+void rabbit_rng_init(struct rabbit_rng *rng, const uint8_t key[16], const uint8_t iv[8]);
+
+// Generator seeded from the kernel (getrandom)
+// Return value: 0 (if all is well), -1 (no entropy available)
+int rabbit_rng_seed(struct rabbit_rng *rng);
+
+void rabbit_rng_bytes(struct rabbit_rng *rng, void *out, size_t len);
+
+// Wipe the generator state
+void rabbit_rng_wipe(struct rabbit_rng *rng);
+
+/*
+ * Substream id of the key of base: the keystream of that key with the
+ * IV id (little-endian). Give every thread its own id to get
+ * independent, reproducible streams without sharing a generator.
+*/
+void rabbit_rng_substream(struct rabbit_rng *rng, const struct rabbit_rng *base, uint64_t id);
+
+uint32_t rabbit_rng_u32(struct rabbit_rng *rng);
+
+uint64_t rabbit_rng_u64(struct rabbit_rng *rng);
+
+/*
+ * Typed batches. The keystream is taken in blocks of words and
+ * converted in plain scalar loops, left to the auto-vectorizer (the
+ * normal draws branch per element), the same calls on the same stream
+ * give the same values.
+ * float - uniform on [0, 1), 24 random mantissa bits
+ * double - uniform on [0, 1), 53 random mantissa bits
+ * bounded - uniform on [0, bound), Lemire's multiply-and-reject
+ * (bound 0 gives the whole 32-bit range)
+ * normal - ziggurat, mean and standard deviation stddev
+*/
+void rabbit_rng_float(struct rabbit_rng *rng, float *out, size_t n);
+
+void rabbit_rng_double(struct rabbit_rng *rng, double *out, size_t n);
+
+void rabbit_rng_bounded(struct rabbit_rng *rng, uint32_t *out, size_t n, uint32_t bound);
+
+void rabbit_rng_normal(struct rabbit_rng *rng, double *out, size_t n, double mean, double stddev);
+
+/*
+ * Random bytes from the generator of the calling thread. It is seeded
+ * from getrandom at the first call of the thread and again in the
+ * child after a fork, no lock is taken. It is wiped when the thread
+ * exits (not at exit() of the process).
+ * Return value: 0 (if all is well), -1 (seeding failed, out untouched)
+*/
+int rabbit_random(void *out, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
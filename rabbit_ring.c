@@ -0,0 +1,349 @@
+/*
+ * Keystream precomputation ring of the RABBIT-128 library.
+ * head counts the tiles claimed, tail the tiles consumed, both only
+ * grow; tile n lives in slot n % nslots. A tile is claimed by a CAS
+ * on head, by the helper thread or by the consumer when the ring is
+ * dry, so neither of them ever waits for the other:
+ *  - the helper has its own generator, it skips the tiles the
+ *    consumer claimed and publishes every tile it made with seq
+ *  - the consumer keeps the state at the start of its tile; a tile
+ *    that is not published yet is crypted straight on that state, as
+ *    rabbit_crypt_stream does, even if the helper is still at it. On
+ *    a dry ring it claims the tiles of the whole call at once.
+ * Slots are written by the helper alone. The helper fills the ring up
+ * and sleeps until half of it is free, so the consumer wakes it once
+ * per half ring, not once per tile. With a single CPU online the
+ * helper could only take time from the consumer: it is not started and
+ * the consumer crypts every tile itself.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_ring.h"
+
+struct rabbit_ring {
+	// Helper side: its generator is at the start of the tile gpos
+	struct rabbit_context gen;
+	uint64_t gpos;
+
+	uint8_t *tiles;			// nslots * RABBIT_TILE bytes
+	struct rabbit_master *end;	// state at the end of every tile
+	uint64_t *seq;			// tile number + 1 once the slot holds it
+	uint32_t nslots;
+	uint32_t lowat;			// free slots that wake the helper up
+
+	uint64_t head __attribute__((aligned(64)));
+
+	// Consumer side
+	uint64_t tail __attribute__((aligned(64)));
+	uint64_t off;			// consumed bytes from the start of the tail tile
+	const uint8_t *tile;		// slot of the tail tile, if the helper made it
+	uint64_t own_end;		// tiles up to own_end are crypted on own_ctx, 0 if none
+	struct rabbit_context cur;	// state at the start of the tail tile
+	struct rabbit_context own_ctx;	// stream position in these tiles
+	uint8_t lead[16];		// leftover of the context given to rabbit_ring_new
+	uint32_t nlead;
+
+	// Sleep of the helper from a full ring to the low-water mark
+	int waiting __attribute__((aligned(64)));
+	int stop;
+	int helper;			// the helper thread runs
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+};
+
+// Free slots of the ring
+static uint64_t
+ring_free(struct rabbit_ring *r)
+{
+	return r->nslots - (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) -
+		__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST));
+}
+
+// Claim the next tile for the helper, 0 if the ring is full
+static int
+ring_claim(struct rabbit_ring *r, uint64_t *tile)
+{
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	do {
+		if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->nslots)
+			return 0;
+	} while(!__atomic_compare_exchange_n(&r->head, &head, head + 1, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	*tile = head;
+
+	return 1;
+}
+
+// Generate the claimed tile into its slot and publish it
+static void
+ring_produce(struct rabbit_ring *r, uint64_t n)
+{
+	uint32_t slot = n % r->nslots;
+
+	// The tiles in between went to the consumer
+	if(r->gpos < n)
+		rabbit_skip(&r->gen, (n - r->gpos) * (RABBIT_TILE / 16));
+
+	rabbit_backend_get()->keystream(&r->gen, r->tiles + (size_t)slot * RABBIT_TILE, RABBIT_TILE / 16);
+	r->gpos = n + 1;
+
+	memcpy(r->end[slot].x, r->gen.x, sizeof(r->gen.x));
+	memcpy(r->end[slot].c, r->gen.c, sizeof(r->gen.c));
+	r->end[slot].carry = r->gen.carry;
+
+	__atomic_store_n(&r->seq[slot], n + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * The helper thread: fill the ring, then sleep until the low-water mark.
+ * waiting is set again before every check of the ring, the consumer
+ * clears it when it signals.
+*/
+static void *
+ring_producer(void *arg)
+{
+	struct rabbit_ring *r = arg;
+	uint64_t n;
+
+	while(!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+		if(ring_claim(r, &n)) {
+			ring_produce(r, n);
+			continue;
+		}
+
+		pthread_mutex_lock(&r->mutex);
+		for(;;) {
+			__atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+			if(ring_free(r) >= r->lowat || __atomic_load_n(&r->stop, __ATOMIC_ACQUIRE))
+				break;
+			pthread_cond_wait(&r->cond, &r->mutex);
+		}
+		__atomic_store_n(&r->waiting, 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&r->mutex);
+	}
+
+	return NULL;
+}
+
+// Wake the helper up, if it sleeps and the ring is down to the low-water mark
+static void
+ring_wake(struct rabbit_ring *r)
+{
+	if(__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST) && ring_free(r) >= r->lowat &&
+		__atomic_exchange_n(&r->waiting, 0, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&r->mutex);
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->mutex);
+	}
+}
+
+// Is the tail tile published by the helper?
+static int
+ring_ready(struct rabbit_ring *r, uint64_t tail)
+{
+	return __atomic_load_n(&r->seq[tail % r->nslots], __ATOMIC_ACQUIRE) == tail + 1;
+}
+
+/*
+ * The consumer takes the tiles from tail on: want of them if the ring
+ * is dry, else the tail tile alone, which the helper is still at and
+ * loses. Return value: the end of the tiles taken
+*/
+static uint64_t
+ring_take(struct rabbit_ring *r, uint64_t tail, uint64_t want)
+{
+	uint64_t head = tail;
+
+	if(want > r->nslots)
+		want = r->nslots;
+
+	if(__atomic_compare_exchange_n(&r->head, &head, tail + want, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return tail + want;
+
+	return tail + 1;
+}
+
+// The tail tile (or the own tiles) is done: move to the start of the next one
+static void
+ring_advance(struct rabbit_ring *r)
+{
+	uint64_t tail = r->tail + 1;
+	const struct rabbit_master *end;
+
+	if(r->own_end) {
+		tail = r->own_end;
+		memcpy(r->cur.x, r->own_ctx.x, sizeof(r->cur.x));
+		memcpy(r->cur.c, r->own_ctx.c, sizeof(r->cur.c));
+		r->cur.carry = r->own_ctx.carry;
+	} else {
+		end = &r->end[r->tail % r->nslots];
+		memcpy(r->cur.x, end->x, sizeof(r->cur.x));
+		memcpy(r->cur.c, end->c, sizeof(r->cur.c));
+		r->cur.carry = end->carry;
+	}
+
+	r->tile = NULL;
+	r->own_end = 0;
+	r->off = 0;
+	__atomic_store_n(&r->tail, tail, __ATOMIC_SEQ_CST);
+	ring_wake(r);
+}
+
+struct rabbit_ring *
+rabbit_ring_new(const struct rabbit_context *ctx, size_t depth)
+{
+	struct rabbit_ring *r;
+	size_t nslots;
+
+	nslots = (depth + RABBIT_TILE - 1) / RABBIT_TILE;
+	if(nslots < 2)
+		nslots = 2;
+	if(nslots > UINT32_MAX)
+		return NULL;
+
+	r = aligned_alloc(64, (sizeof(*r) + 63) & ~(size_t)63);
+	if(r == NULL)
+		return NULL;
+	memset(r, 0, sizeof(*r));
+
+	r->nslots = nslots;
+	r->lowat = nslots / 2;
+	r->tiles = aligned_alloc(64, nslots * RABBIT_TILE);
+	r->end = malloc(nslots * sizeof(*r->end));
+	r->seq = calloc(nslots, sizeof(*r->seq));
+
+	if(r->tiles == NULL || r->end == NULL || r->seq == NULL)
+		goto fail;
+
+	r->gen = *ctx;
+	r->gen.nleft = 0;
+	r->cur = r->gen;
+
+	// The leftover of the context goes out first
+	r->nlead = ctx->nleft;
+	memcpy(r->lead, ctx->leftover, sizeof(r->lead));
+
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_cond_init(&r->cond, NULL);
+
+	r->helper = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+	if(r->helper && pthread_create(&r->thread, NULL, ring_producer, r)) {
+		pthread_mutex_destroy(&r->mutex);
+		pthread_cond_destroy(&r->cond);
+		goto fail;
+	}
+
+	return r;
+
+fail:
+	free(r->tiles);
+	free(r->end);
+	free(r->seq);
+	rabbit_wipe(r, sizeof(*r));
+	free(r);
+	return NULL;
+}
+
+void
+rabbit_ring_free(struct rabbit_ring *r, struct rabbit_context *ctx)
+{
+	if(r == NULL)
+		return;
+
+	if(r->helper) {
+		__atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+		pthread_mutex_lock(&r->mutex);
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->mutex);
+		pthread_join(r->thread, NULL);
+	}
+
+	if(ctx != NULL && r->own_end) {
+		// Up to the consumer, inside a tile it crypts itself
+		memcpy(ctx->x, r->own_ctx.x, sizeof(ctx->x));
+		memcpy(ctx->c, r->own_ctx.c, sizeof(ctx->c));
+		ctx->carry = r->own_ctx.carry;
+		ctx->nleft = r->own_ctx.nleft;
+		memcpy(ctx->leftover, r->own_ctx.leftover, sizeof(ctx->leftover));
+	} else if(ctx != NULL) {
+		// The state at the start of the tail tile
+		memcpy(ctx->x, r->cur.x, sizeof(ctx->x));
+		memcpy(ctx->c, r->cur.c, sizeof(ctx->c));
+		ctx->carry = r->cur.carry;
+		ctx->nleft = 0;
+
+		if(r->nlead) {
+			memcpy(ctx->leftover, r->lead, sizeof(r->lead));
+			ctx->nleft = r->nlead;
+		} else if(r->off) {
+			// Up to the consumer, the partial block becomes the leftover
+			rabbit_skip(ctx, r->off / 16 + ((r->off & 15) != 0));
+			if(r->off & 15) {
+				memcpy(ctx->leftover, r->tile + (r->off & ~15U), 16);
+				ctx->nleft = 16 - (r->off & 15);
+			}
+		}
+	}
+
+	rabbit_wipe(r->tiles, (size_t)r->nslots * RABBIT_TILE);
+	rabbit_wipe(r->end, r->nslots * sizeof(*r->end));
+
+	pthread_mutex_destroy(&r->mutex);
+	pthread_cond_destroy(&r->cond);
+	free(r->tiles);
+	free(r->end);
+	free(r->seq);
+	rabbit_wipe(r, sizeof(*r));
+	free(r);
+}
+
+void
+rabbit_ring_crypt(struct rabbit_ring *r, const uint8_t *buf, size_t buflen, uint8_t *out)
+{
+	const struct rabbit_backend *b = rabbit_backend_get();
+	uint64_t size;
+	size_t n, i;
+
+	// The leftover of the context
+	n = (buflen < r->nlead) ? buflen : r->nlead;
+	for(i = 0; i < n; i++)
+		out[i] = buf[i] ^ r->lead[16 - r->nlead + i];
+	r->nlead -= n;
+	buflen -= n, buf += n, out += n;
+
+	while(buflen) {
+		if(r->tile == NULL && !r->own_end) {
+			if(ring_ready(r, r->tail))
+				r->tile = r->tiles + (size_t)(r->tail % r->nslots) * RABBIT_TILE;
+			else {
+				size = r->helper ? (buflen + RABBIT_TILE - 1) / RABBIT_TILE : r->nslots;
+				r->own_end = ring_take(r, r->tail, size);
+				r->own_ctx = r->cur;
+			}
+		}
+
+		size = r->own_end ? (r->own_end - r->tail) * RABBIT_TILE : RABBIT_TILE;
+		n = (buflen < size - r->off) ? buflen : size - r->off;
+
+		if(r->own_end)
+			rabbit_crypt_stream(&r->own_ctx, buf, n, out);
+		else
+			b->xor_tile(out, buf, r->tile + r->off, n, 0);
+		buflen -= n, buf += n, out += n;
+
+		r->off += n;
+		if(r->off == size)
+			ring_advance(r);
+	}
+}
@@ -0,0 +1,50 @@
+/*
+ * Keystream precomputation ring of the RABBIT-128 library.
+ * A helper thread generates the keystream of one context ahead into a
+ * single-producer single-consumer ring of tiles, so the crypt call on
+ * the hot thread is a pure XOR against precomputed bytes. When the ring
+ * runs dry the hot thread crypts the next tiles itself, it never waits
+ * for the helper. With a single CPU online there is no helper thread.
+*/
+
+#ifndef RABBIT_RING_H
+#define RABBIT_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rabbit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rabbit_ring;
+
+/*
+ * Start a ring on the stream of ctx.
+ * depth - look-ahead in bytes, rounded up to whole tiles (two at least)
+ * The ring works on its own copy of the context, ctx is not used until
+ * rabbit_ring_free gives the stream back. NULL if out of memory or the
+ * thread can not be started.
+*/
+struct rabbit_ring *rabbit_ring_new(const struct rabbit_context *ctx, size_t depth);
+
+/*
+ * Stop the helper thread. If ctx is not NULL, the working state of ctx
+ * is set to the position of the consumer, the stream then goes on with
+ * rabbit_crypt_stream as if the ring was never used.
+*/
+void rabbit_ring_free(struct rabbit_ring *r, struct rabbit_context *ctx);
+
+/*
+ * Stream crypt from the ring, same output as rabbit_crypt_stream.
+ * Only one thread may call it. buf may be equal to out.
+*/
+void rabbit_ring_crypt(struct rabbit_ring *r, const uint8_t *buf, size_t buflen, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,419 @@
+/*
+ * Session table of the RABBIT-128 library.
+ * The slots live in slabs of RABBIT_SLAB_SESSIONS sessions, each slab
+ * is an array of struct rabbit_x16 groups: slot s is the lane s % 16
+ * of the group s / 16. An open-addressing hash (linear probing) maps
+ * the session ids on the slots.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_session.h"
+
+#define SLAB_GROUPS	(RABBIT_SLAB_SESSIONS / 16)
+
+// Hash entries: 0 - never used, HASH_DELETED - removed, else slot + 1
+#define HASH_DELETED	UINT32_MAX
+#define NO_SLOT		UINT32_MAX
+
+// How far a batch pass looks ahead for packets of the same group
+#define BATCH_WINDOW	256
+// Fewer packets in a group pass are done one by one, the masked
+// sixteen-lane kernel only pays off with enough active lanes
+#define BATCH_MIN_LANES	6
+
+struct rabbit_slab {
+	struct rabbit_x16 group[SLAB_GROUPS];
+};
+
+struct rabbit_session_table {
+	struct rabbit_slab **slab;
+	size_t nslabs;
+
+	uint32_t *free;		// stack of the free slots
+	size_t nfree;
+
+	uint64_t *hash_id;
+	uint32_t *hash_slot;
+	size_t hash_size;	// power of 2
+	size_t hash_used;	// live and deleted entries
+	size_t count;
+};
+
+static inline size_t
+session_hash(uint64_t id)
+{
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdULL;
+	id ^= id >> 33;
+	id *= 0xc4ceb9fe1a85ec53ULL;
+	id ^= id >> 33;
+
+	return (size_t)id;
+}
+
+static inline struct rabbit_x16 *
+session_group(const struct rabbit_session_table *t, uint32_t slot)
+{
+	return &t->slab[slot / RABBIT_SLAB_SESSIONS]->group[(slot % RABBIT_SLAB_SESSIONS) / 16];
+}
+
+// Copy the lane of a group into a context
+static void
+session_load(const struct rabbit_x16 *g, int lane, struct rabbit_context *ctx)
+{
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		ctx->x[i] = g->x[i][lane];
+		ctx->c[i] = g->c[i][lane];
+	}
+	ctx->carry = g->carry[lane];
+}
+
+// Copy a context into the lane of a group
+static void
+session_store(struct rabbit_x16 *g, int lane, const struct rabbit_context *ctx)
+{
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		g->x[i][lane] = ctx->x[i];
+		g->c[i][lane] = ctx->c[i];
+	}
+	g->carry[lane] = ctx->carry;
+}
+
+// Hash position of id, or of the first free entry if it is not there
+static size_t
+hash_probe(const struct rabbit_session_table *t, uint64_t id, int *found)
+{
+	size_t mask = t->hash_size - 1, i, first = SIZE_MAX;
+
+	for(i = session_hash(id) & mask; ; i = (i + 1) & mask) {
+		if(t->hash_slot[i] == 0)
+			break;
+
+		if(t->hash_slot[i] == HASH_DELETED) {
+			if(first == SIZE_MAX)
+				first = i;
+		} else if(t->hash_id[i] == id) {
+			*found = 1;
+			return i;
+		}
+	}
+
+	*found = 0;
+
+	return (first != SIZE_MAX) ? first : i;
+}
+
+static uint32_t
+session_find(const struct rabbit_session_table *t, uint64_t id)
+{
+	size_t i;
+	int found;
+
+	i = hash_probe(t, id, &found);
+
+	return found ? t->hash_slot[i] - 1 : NO_SLOT;
+}
+
+// Rebuild the hash with size entries, the deleted entries are dropped
+static int
+hash_resize(struct rabbit_session_table *t, size_t size)
+{
+	uint64_t *old_id = t->hash_id;
+	uint32_t *old_slot = t->hash_slot;
+	size_t old_size = t->hash_size, i, j;
+	int found;
+
+	t->hash_id = malloc(size * sizeof(*t->hash_id));
+	t->hash_slot = calloc(size, sizeof(*t->hash_slot));
+
+	if(t->hash_id == NULL || t->hash_slot == NULL) {
+		free(t->hash_id);
+		free(t->hash_slot);
+		t->hash_id = old_id;
+		t->hash_slot = old_slot;
+		return -1;
+	}
+
+	t->hash_size = size;
+	t->hash_used = t->count;
+
+	for(i = 0; i < old_size; i++) {
+		if(old_slot[i] == 0 || old_slot[i] == HASH_DELETED)
+			continue;
+
+		j = hash_probe(t, old_id[i], &found);
+		t->hash_id[j] = old_id[i];
+		t->hash_slot[j] = old_slot[i];
+	}
+
+	free(old_id);
+	free(old_slot);
+
+	return 0;
+}
+
+// One more slab, its slots go on the free stack lowest first
+static int
+slab_add(struct rabbit_session_table *t)
+{
+	struct rabbit_slab **slab, *s;
+	uint32_t *free_slots;
+	size_t i, base;
+
+	slab = realloc(t->slab, (t->nslabs + 1) * sizeof(*slab));
+	if(slab == NULL)
+		return -1;
+	t->slab = slab;
+
+	free_slots = realloc(t->free, (t->nslabs + 1) * RABBIT_SLAB_SESSIONS * sizeof(*free_slots));
+	if(free_slots == NULL)
+		return -1;
+	t->free = free_slots;
+
+	s = aligned_alloc(64, sizeof(*s));
+	if(s == NULL)
+		return -1;
+	memset(s, 0, sizeof(*s));
+
+	base = t->nslabs * RABBIT_SLAB_SESSIONS;
+	for(i = 0; i < RABBIT_SLAB_SESSIONS; i++)
+		t->free[t->nfree++] = base + RABBIT_SLAB_SESSIONS - 1 - i;
+
+	t->slab[t->nslabs++] = s;
+
+	return 0;
+}
+
+struct rabbit_session_table *
+rabbit_session_table_new(size_t n)
+{
+	struct rabbit_session_table *t;
+	size_t size = 16;
+
+	t = calloc(1, sizeof(*t));
+	if(t == NULL)
+		return NULL;
+
+	while(size < 2 * n)
+		size <<= 1;
+
+	if(hash_resize(t, size))
+		goto fail;
+
+	do {
+		if(slab_add(t))
+			goto fail;
+	} while(t->nslabs * RABBIT_SLAB_SESSIONS < n);
+
+	return t;
+
+fail:
+	rabbit_session_table_free(t);
+	return NULL;
+}
+
+void
+rabbit_session_table_free(struct rabbit_session_table *t)
+{
+	size_t i;
+
+	if(t == NULL)
+		return;
+
+	for(i = 0; i < t->nslabs; i++) {
+		rabbit_wipe(t->slab[i], sizeof(*t->slab[i]));
+		free(t->slab[i]);
+	}
+
+	free(t->slab);
+	free(t->free);
+	free(t->hash_id);
+	free(t->hash_slot);
+	free(t);
+}
+
+size_t
+rabbit_session_count(const struct rabbit_session_table *t)
+{
+	return t->count;
+}
+
+int
+rabbit_session_add(struct rabbit_session_table *t, uint64_t id,
+	const uint8_t *key, const int keylen, const uint8_t *iv, const int ivlen)
+{
+	struct rabbit_context ctx;
+	uint32_t slot;
+	size_t i;
+	int found;
+
+	// Keep the hash at most half full
+	if(2 * (t->hash_used + 1) > t->hash_size) {
+		if(hash_resize(t, (4 * (t->count + 1) > t->hash_size) ? 2 * t->hash_size : t->hash_size))
+			return -1;
+	}
+
+	i = hash_probe(t, id, &found);
+	if(found)
+		return -1;
+
+	if(t->nfree == 0 && slab_add(t))
+		return -1;
+
+	if(rabbit_set_key_and_iv(&ctx, key, keylen, iv, ivlen))
+		return -1;
+
+	slot = t->free[--t->nfree];
+	session_store(session_group(t, slot), slot % 16, &ctx);
+	rabbit_wipe(&ctx, sizeof(ctx));
+
+	if(t->hash_slot[i] == 0)
+		t->hash_used++;
+	t->hash_id[i] = id;
+	t->hash_slot[i] = slot + 1;
+	t->count++;
+
+	return 0;
+}
+
+int
+rabbit_session_remove(struct rabbit_session_table *t, uint64_t id)
+{
+	struct rabbit_x16 *g;
+	uint32_t slot;
+	size_t i;
+	int found, lane, j;
+
+	i = hash_probe(t, id, &found);
+	if(!found)
+		return -1;
+
+	slot = t->hash_slot[i] - 1;
+	t->hash_slot[i] = HASH_DELETED;
+	t->count--;
+
+	g = session_group(t, slot);
+	lane = slot % 16;
+	for(j = 0; j < 8; j++)
+		g->x[j][lane] = g->c[j][lane] = 0;
+	g->carry[lane] = 0;
+	__asm__ __volatile__("" : : "r"(g) : "memory");
+
+	t->free[t->nfree++] = slot;
+
+	return 0;
+}
+
+// rabbit_crypt on one slot, through a context on the stack
+static void
+session_crypt_slot(struct rabbit_session_table *t, uint32_t slot,
+	const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	struct rabbit_x16 *g = session_group(t, slot);
+	struct rabbit_context ctx;
+
+	session_load(g, slot % 16, &ctx);
+	rabbit_crypt(&ctx, buf, buflen, out);
+	session_store(g, slot % 16, &ctx);
+}
+
+int
+rabbit_session_crypt(struct rabbit_session_table *t, uint64_t id,
+	const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	uint32_t slot;
+
+	if((slot = session_find(t, id)) == NO_SLOT)
+		return -1;
+
+	session_crypt_slot(t, slot, buf, buflen, out);
+
+	return 0;
+}
+
+int
+rabbit_session_crypt_batch(struct rabbit_session_table *t, const uint64_t *id,
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out, size_t n)
+{
+	static const uint8_t none[1];
+	const uint8_t *lbuf[16];
+	uint8_t *lout[16], dummy[1];
+	uint32_t *slot, llen[16], group;
+	size_t i, j, pick[16];
+	int ret = 0, lane, taken, lanes;
+
+	slot = (rabbit_backend_get()->lanes == 16) ? malloc(n * sizeof(*slot)) : NULL;
+
+	// Without the sixteen-lane kernel the packets go one by one
+	if(slot == NULL) {
+		for(i = 0; i < n; i++)
+			if(rabbit_session_crypt(t, id[i], buf[i], buflen[i], out[i]))
+				ret = -1;
+		return ret;
+	}
+
+	for(i = 0; i < n; i++)
+		if((slot[i] = session_find(t, id[i])) == NO_SLOT)
+			ret = -1;
+
+	for(i = 0; i < n; i++) {
+		if(slot[i] == NO_SLOT)
+			continue;
+
+		// The first pending packet of every lane of the group;
+		// the later packets of a taken lane wait for the next pass
+		group = slot[i] / 16;
+		taken = 0;
+		lanes = 0;
+
+		for(j = i; j < n && j < i + BATCH_WINDOW; j++) {
+			if(slot[j] == NO_SLOT || slot[j] / 16 != group)
+				continue;
+
+			lane = slot[j] % 16;
+			if(taken & (1 << lane))
+				continue;
+
+			taken |= 1 << lane;
+			pick[lanes++] = j;
+		}
+
+		if(lanes < BATCH_MIN_LANES) {
+			for(j = 0; j < lanes; j++) {
+				session_crypt_slot(t, slot[pick[j]], buf[pick[j]], buflen[pick[j]], out[pick[j]]);
+				slot[pick[j]] = NO_SLOT;
+			}
+			continue;
+		}
+
+		for(lane = 0; lane < 16; lane++) {
+			lbuf[lane] = none;
+			lout[lane] = dummy;
+			llen[lane] = 0;
+		}
+
+		for(j = 0; j < lanes; j++) {
+			lane = slot[pick[j]] % 16;
+			lbuf[lane] = buf[pick[j]];
+			lout[lane] = out[pick[j]];
+			llen[lane] = buflen[pick[j]];
+			slot[pick[j]] = NO_SLOT;
+		}
+
+		rabbit_x16_crypt(session_group(t, group * 16), lbuf, llen, lout);
+	}
+
+	free(slot);
+
+	return ret;
+}
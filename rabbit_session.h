@@ -0,0 +1,64 @@
+/*
+ * Session table of the RABBIT-128 library.
+ * Holds many stream contexts, addressed by a 64-bit session id.
+ * The states are kept in the transposed (structure-of-arrays) layout,
+ * sixteen sessions per group, in slabs of RABBIT_SLAB_SESSIONS.
+ * Only the working state is stored: 68 bytes per session, no key
+ * and no master state.
+*/
+
+#ifndef RABBIT_SESSION_H
+#define RABBIT_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RABBIT_SLAB_SESSIONS	1024
+
+struct rabbit_session_table;
+
+// New table with room for n sessions before it grows, NULL if out of memory
+struct rabbit_session_table *rabbit_session_table_new(size_t n);
+
+void rabbit_session_table_free(struct rabbit_session_table *t);
+
+// Number of sessions in the table
+size_t rabbit_session_count(const struct rabbit_session_table *t);
+
+/*
+ * Add the session id, keyed like rabbit_set_key_and_iv.
+ * Return value: 0 (if all is well), -1 (bad key or IV, id already
+ * in the table, out of memory)
+*/
+int rabbit_session_add(struct rabbit_session_table *t, uint64_t id,
+	const uint8_t *key, const int keylen, const uint8_t *iv, const int ivlen);
+
+// Remove the session id, its state is wiped
+// Return value: 0 (if all is well), -1 (unknown id)
+int rabbit_session_remove(struct rabbit_session_table *t, uint64_t id);
+
+// rabbit_crypt on the stream of the session id
+// Return value: 0 (if all is well), -1 (unknown id)
+int rabbit_session_crypt(struct rabbit_session_table *t, uint64_t id,
+	const uint8_t *buf, uint32_t buflen, uint8_t *out);
+
+/*
+ * Crypt a batch of n packets, packet i on the session id[i].
+ * The packets of one session are processed in the batch order.
+ * With the AVX-512 backend, the packets of sessions sharing a group
+ * are done in one masked sixteen-lane pass, straight on the table.
+ * Return value: 0 (if all is well), -1 (some id unknown, these
+ * packets are left untouched)
+*/
+int rabbit_session_crypt_batch(struct rabbit_session_table *t, const uint64_t *id,
+	const uint8_t **buf, const uint32_t *buflen, uint8_t **out, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
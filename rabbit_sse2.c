@@ -0,0 +1,240 @@
+/*
+ * SSE2 backend of the RABBIT-128 algorithm.
+ * The file is compiled with -msse2.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_core.h"
+
+/*
+ * Single-stream kernel: one context, x[8] and c[8] in two registers
+ * each (words 0-3 and 4-7). The counter carry chain is resolved with
+ * the carry-lookahead of the AVX2 kernel on the two lane masks. SSE2
+ * has no blend nor byte shuffle, so the g[i-1] and g[i-2] moves are
+ * byte shifts across the two halves and the per-lane rotations are
+ * masked selects.
+*/
+
+// g function of four words: the upper and lower 32 bits of u * u XORed
+static inline __m128i
+rabbit_sse2_g_func(__m128i u)
+{
+	const __m128i even_mask = _mm_setr_epi32(-1, 0, -1, 0);
+	__m128i even, odd;
+
+	even = _mm_mul_epu32(u, u);
+	odd = _mm_srli_epi64(u, 32);
+	odd = _mm_mul_epu32(odd, odd);
+
+	even = _mm_xor_si128(even, _mm_srli_epi64(even, 32));
+	odd = _mm_xor_si128(odd, _mm_slli_epi64(odd, 32));
+
+	return _mm_or_si128(_mm_and_si128(even_mask, even), _mm_andnot_si128(even_mask, odd));
+}
+
+// Rotations of g[i-1] into lane i: left by 16 in the even lanes, by 8 in the odd ones
+static inline __m128i
+rabbit_sse2_rot1(__m128i v)
+{
+	const __m128i even_mask = _mm_setr_epi32(-1, 0, -1, 0);
+	__m128i r16, r8;
+
+	r16 = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+	r8 = _mm_or_si128(_mm_slli_epi32(v, 8), _mm_srli_epi32(v, 24));
+
+	return _mm_or_si128(_mm_and_si128(even_mask, r16), _mm_andnot_si128(even_mask, r8));
+}
+
+// Rotations of g[i-2] into lane i: left by 16 in the even lanes, none in the odd ones
+static inline __m128i
+rabbit_sse2_rot2(__m128i v)
+{
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 2, 0, 1));
+	return _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 2, 0, 1));
+}
+
+// Calculate the next internal state of one context
+static inline void
+rabbit_sse2_next_state(__m128i x[2], __m128i c[2], uint32_t *carry)
+{
+	const __m128i a_lo = _mm_setr_epi32(RABBIT_A0, RABBIT_A1, RABBIT_A2, RABBIT_A3);
+	const __m128i a_hi = _mm_setr_epi32(RABBIT_A4, RABBIT_A5, RABBIT_A6, RABBIT_A7);
+	const __m128i bias = _mm_set1_epi32(0x80000000);
+	const __m128i ones = _mm_set1_epi32(-1);
+	const __m128i bits_lo = _mm_setr_epi32(1, 2, 4, 8);
+	const __m128i bits_hi = _mm_setr_epi32(16, 32, 64, 128);
+	__m128i s_lo, s_hi, t_v, g_lo, g_hi, p_lo, p_hi;
+	uint32_t gen, prop, t;
+
+	s_lo = _mm_add_epi32(c[0], a_lo);
+	s_hi = _mm_add_epi32(c[1], a_hi);
+	gen = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+		_mm_xor_si128(c[0], bias), _mm_xor_si128(s_lo, bias))));
+	gen |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+		_mm_xor_si128(c[1], bias), _mm_xor_si128(s_hi, bias)))) << 4;
+	prop = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(s_lo, ones)));
+	prop |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(s_hi, ones))) << 4;
+
+	t = (((gen << 1) | *carry) + prop) ^ prop;
+	*carry = t >> 8;
+
+	// Lanes with a carry in get -1 from the compare, subtracting adds one
+	t_v = _mm_set1_epi32(t);
+	c[0] = _mm_sub_epi32(s_lo, _mm_cmpeq_epi32(_mm_and_si128(t_v, bits_lo), bits_lo));
+	c[1] = _mm_sub_epi32(s_hi, _mm_cmpeq_epi32(_mm_and_si128(t_v, bits_hi), bits_hi));
+
+	g_lo = rabbit_sse2_g_func(_mm_add_epi32(x[0], c[0]));
+	g_hi = rabbit_sse2_g_func(_mm_add_epi32(x[1], c[1]));
+
+	// g[i-1]: (g7, g0, g1, g2) and (g3, g4, g5, g6)
+	p_lo = _mm_or_si128(_mm_slli_si128(g_lo, 4), _mm_srli_si128(g_hi, 12));
+	p_hi = _mm_or_si128(_mm_slli_si128(g_hi, 4), _mm_srli_si128(g_lo, 12));
+	x[0] = _mm_add_epi32(g_lo, rabbit_sse2_rot1(p_lo));
+	x[1] = _mm_add_epi32(g_hi, rabbit_sse2_rot1(p_hi));
+
+	// g[i-2]: (g6, g7, g0, g1) and (g2, g3, g4, g5)
+	p_lo = _mm_or_si128(_mm_slli_si128(g_lo, 8), _mm_srli_si128(g_hi, 8));
+	p_hi = _mm_or_si128(_mm_slli_si128(g_hi, 8), _mm_srli_si128(g_lo, 8));
+	x[0] = _mm_add_epi32(x[0], rabbit_sse2_rot2(p_lo));
+	x[1] = _mm_add_epi32(x[1], rabbit_sse2_rot2(p_hi));
+}
+
+// Keystream block of one context
+static inline __m128i
+rabbit_sse2_keystream(const __m128i x[2])
+{
+	__m128i lo, hi, even, odd, s;
+
+	// (x0, x2, x1, x3) and (x4, x6, x5, x7)
+	lo = _mm_shuffle_epi32(x[0], _MM_SHUFFLE(3, 1, 2, 0));
+	hi = _mm_shuffle_epi32(x[1], _MM_SHUFFLE(3, 1, 2, 0));
+	even = _mm_unpacklo_epi64(lo, hi);
+	odd = _mm_unpackhi_epi64(lo, hi);
+
+	// x0 ^ x5 >> 16 ^ x3 << 16, x2 ^ x7 >> 16 ^ x5 << 16, ...
+	s = _mm_xor_si128(even, _mm_srli_epi32(_mm_shuffle_epi32(odd, _MM_SHUFFLE(1, 0, 3, 2)), 16));
+	return _mm_xor_si128(s, _mm_slli_epi32(_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 3, 2, 1)), 16));
+}
+
+static inline void
+rabbit_sse2_load(const struct rabbit_context *ctx, __m128i x[2], __m128i c[2])
+{
+	x[0] = _mm_loadu_si128((const __m128i *)ctx->x);
+	x[1] = _mm_loadu_si128((const __m128i *)(ctx->x + 4));
+	c[0] = _mm_loadu_si128((const __m128i *)ctx->c);
+	c[1] = _mm_loadu_si128((const __m128i *)(ctx->c + 4));
+}
+
+static inline void
+rabbit_sse2_store(struct rabbit_context *ctx, const __m128i x[2], const __m128i c[2])
+{
+	_mm_storeu_si128((__m128i *)ctx->x, x[0]);
+	_mm_storeu_si128((__m128i *)(ctx->x + 4), x[1]);
+	_mm_storeu_si128((__m128i *)ctx->c, c[0]);
+	_mm_storeu_si128((__m128i *)(ctx->c + 4), c[1]);
+}
+
+// Single-stream backend: the state stays in four registers for the whole call
+void
+rabbit_crypt_sse2(struct rabbit_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	__m128i x[2], c[2], ks;
+	uint8_t tail[16];
+	uint32_t carry, i;
+
+	rabbit_sse2_load(ctx, x, c);
+	carry = ctx->carry;
+
+	for(; buflen >= 16; buflen -= 16, buf += 16, out += 16) {
+		rabbit_sse2_next_state(x, c, &carry);
+
+		ks = rabbit_sse2_keystream(x);
+		_mm_storeu_si128((__m128i *)out, _mm_xor_si128(ks, _mm_loadu_si128((const __m128i *)buf)));
+	}
+
+	if(buflen) {
+		rabbit_sse2_next_state(x, c, &carry);
+
+		_mm_storeu_si128((__m128i *)tail, rabbit_sse2_keystream(x));
+		for(i = 0; i < buflen; i++)
+			out[i] = buf[i] ^ tail[i];
+	}
+
+	rabbit_sse2_store(ctx, x, c);
+	ctx->carry = carry;
+}
+
+// Keystream generation without the data
+void
+rabbit_keystream_sse2(struct rabbit_context *ctx, uint8_t *ks, uint32_t nblocks)
+{
+	__m128i x[2], c[2];
+	uint32_t carry;
+
+	rabbit_sse2_load(ctx, x, c);
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--, ks += 16) {
+		rabbit_sse2_next_state(x, c, &carry);
+		_mm_store_si128((__m128i *)ks, rabbit_sse2_keystream(x));
+	}
+
+	rabbit_sse2_store(ctx, x, c);
+	ctx->carry = carry;
+}
+
+// Advance the state without the keystream output
+void
+rabbit_skip_sse2(struct rabbit_context *ctx, uint64_t nblocks)
+{
+	__m128i x[2], c[2];
+	uint32_t carry;
+
+	rabbit_sse2_load(ctx, x, c);
+	carry = ctx->carry;
+
+	for(; nblocks; nblocks--)
+		rabbit_sse2_next_state(x, c, &carry);
+
+	rabbit_sse2_store(ctx, x, c);
+	ctx->carry = carry;
+}
+
+/*
+ * XOR a keystream tile into the data with 128-bit loads.
+ * The head is peeled up to the 16-byte alignment of out, then the
+ * stores are aligned. With nt they bypass the caches.
+*/
+void
+rabbit_xor_sse2(uint8_t *out, const uint8_t *buf, const uint8_t *ks, uint32_t len, int nt)
+{
+	__m128i v;
+	uint32_t head;
+
+	head = (16 - ((uintptr_t)out & 15)) & 15;
+	if(head > len)
+		head = len;
+	rabbit_core_xor(out, buf, ks, head);
+	out += head, buf += head, ks += head, len -= head;
+
+	if(nt) {
+		for(; len >= 16; len -= 16, buf += 16, ks += 16, out += 16) {
+			v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)buf), _mm_loadu_si128((const __m128i *)ks));
+			_mm_stream_si128((__m128i *)out, v);
+		}
+	}
+
+	for(; len >= 16; len -= 16, buf += 16, ks += 16, out += 16) {
+		v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)buf), _mm_loadu_si128((const __m128i *)ks));
+		_mm_store_si128((__m128i *)out, v);
+	}
+
+	rabbit_core_xor(out, buf, ks, len);
+}
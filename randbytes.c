@@ -0,0 +1,144 @@
+/*
+ * Random bytes to the standard output from the RABBIT-128 generator
+ * ./randbytes -n 1G > file
+ * ./randbytes | consumer (until the consumer stops reading)
+ * The generator is seeded from the kernel, the output is not reproducible.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "rabbit.h"
+#include "rabbit_random.h"
+
+#define BLOCK	(1 << 20)
+
+// Help function
+void
+help(void)
+{
+	printf("\nThis program writes random bytes to the standard output.\n");
+	printf("\nOptions:\n");
+	printf("\t--help(-h) - reference manual\n");
+	printf("\t--count(-n) - number of bytes, K, M, G and T suffixes allowed. By default - no limit\n");
+	printf("\t--block(-b) - size of one write. By default = %d\n", BLOCK);
+	printf("Example: ./randbytes -n 10G > random.bin\n\n");
+}
+
+// Byte count with an optional binary suffix
+// Return value: 0 (if all is well), -1 (not a count)
+int
+parse_count(const char *s, uint64_t *count)
+{
+	char *end;
+	uint64_t n;
+
+	n = strtoull(s, &end, 10);
+	if(end == s)
+		return -1;
+
+	switch(*end) {
+	case 'T' : n <<= 10;
+		   /* fall through */
+	case 'G' : n <<= 10;
+		   /* fall through */
+	case 'M' : n <<= 10;
+		   /* fall through */
+	case 'K' : n <<= 10;
+		   end++;
+	}
+
+	if(*end != '\0')
+		return -1;
+
+	*count = n;
+
+	return 0;
+}
+
+// Write the whole buffer, -1 if the output is closed
+int
+write_all(const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	while(len) {
+		n = write(STDOUT_FILENO, buf, len);
+		if(n <= 0)
+			return -1;
+		buf += n, len -= n;
+	}
+
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct rabbit_rng *rng;
+	uint64_t count = 0, block = BLOCK;
+	size_t n;
+	uint8_t *buf;
+	int res, limit = 0;
+
+	const struct option long_option [] = {
+		{"count",  1, NULL, 'n'},
+		{"block",  1, NULL, 'b'},
+		{"help",   0, NULL, 'h'},
+		{0, 	   0, NULL,  0 }
+	};
+
+	while((res = getopt_long(argc, argv, "n:b:h", long_option, 0)) != -1) {
+		switch(res) {
+		case 'n' : if(parse_count(optarg, &count)) {
+				   fprintf(stderr, "Bad byte count!\n");
+				   return 1;
+			   }
+			   limit = 1;
+			   break;
+		case 'b' : if(parse_count(optarg, &block) || block == 0 || block > (1 << 30)) {
+				   fprintf(stderr, "Bad block size!\n");
+				   return 1;
+			   }
+			   break;
+		case 'h' : help();
+			   return 0;
+		default :  help();
+			   return 1;
+		}
+	}
+
+	block = (block + 63) & ~(uint64_t)63;
+	buf = aligned_alloc(64, block);
+	rng = aligned_alloc(64, sizeof(*rng));
+
+	if(buf == NULL || rng == NULL) {
+		fprintf(stderr, "Allocates memory error!\n");
+		return 1;
+	}
+
+	if(rabbit_rng_seed(rng)) {
+		fprintf(stderr, "No entropy to seed the generator!\n");
+		return 1;
+	}
+
+	while(!limit || count) {
+		n = (limit && count < block) ? count : block;
+
+		rabbit_rng_bytes(rng, buf, n);
+		if(write_all(buf, n))
+			break;
+
+		count -= limit ? n : 0;
+	}
+
+	rabbit_rng_wipe(rng);
+	free(rng);
+	free(buf);
+
+	return 0;
+}
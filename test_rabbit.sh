@@ -1,5 +1,22 @@
 #!/bin/sh
 
+echo "Test vectors"
+./testvectors || exit 1
+echo "CRC32C trailer"
+tmp=$(mktemp -d) || exit 1
+head -c 100000 /dev/urandom > $tmp/plain
+./bigtest -t 1 -c -b 3000 -i $tmp/plain -o $tmp/enc > /dev/null || exit 1
+./bigtest -t 2 -c -b 7001 -i $tmp/enc -o $tmp/dec > /dev/null || exit 1
+cmp -s $tmp/plain $tmp/dec || { echo "bigtest -c round trip: FAIL"; exit 1; }
+# One flipped ciphertext byte must fail the check
+byte=$(od -An -tu1 -j 50000 -N 1 $tmp/enc)
+printf "\\$(printf %o $(( (byte ^ 1) & 255 )))" | dd of=$tmp/enc bs=1 seek=50000 conv=notrunc 2> /dev/null
+if ./bigtest -t 2 -c -i $tmp/enc -o $tmp/dec > /dev/null; then
+	echo "bigtest -c corruption: FAIL"
+	exit 1
+fi
+rm -r $tmp
+echo "OK"
 echo "Run time main"
 ./main
 echo "Run time developer"
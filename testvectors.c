@@ -1,8 +1,1129 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
 
+#define RABBIT_INLINE
 #include "rabbit.h"
+#include "rabbit_internal.h"
+#include "rabbit_aead.h"
+#include "rabbit_crc32c.h"
+#include "rabbit_mb.h"
+#include "rabbit_pool.h"
+#include "rabbit_random.h"
+#include "rabbit_ring.h"
+#include "rabbit_session.h"
+
+// Backends of rabbit_crypt, the ones the CPU lacks are skipped
+static const char *backends[] = { "scalar", "sse2", "avx2", "avx512" };
+
+#define NBACKENDS	(sizeof(backends) / sizeof(backends[0]))
+
+static int fails;
+
+static void
+check(const char *name, const char *backend, const uint8_t *out, const uint8_t *expected, size_t len)
+{
+	if(memcmp(out, expected, len)) {
+		printf("%s (%s): FAIL\n", name, backend);
+		fails++;
+	}
+}
+
+/*
+ * Nonzero-key vectors, computed with the eSTREAM reference code.
+ * RFC 4503 A.1 (its bytes reversed as the RFC prints them) and the
+ * key2/key3 vectors of test-vectors.txt without an IV, then key2 with
+ * the IV of the second vector above.
+*/
+struct key_vector {
+	uint8_t key[16];
+	int has_iv;
+	uint8_t iv[8];
+	uint8_t out[48];
+	size_t len;
+};
+
+static const struct key_vector key_vectors[] = {
+	{ { 0xAC, 0xC3, 0x51, 0xDC, 0xF1, 0x62, 0xFC, 0x3B,
+	    0xFE, 0x36, 0x3D, 0x2E, 0x29, 0x13, 0x28, 0x91 }, 0, { 0 },
+	  { 0x9C, 0x51, 0xE2, 0x87, 0x84, 0xC3, 0x7F, 0xE9,
+	    0xA1, 0x27, 0xF6, 0x3E, 0xC8, 0xF3, 0x2D, 0x3D,
+	    0x19, 0xFC, 0x54, 0x85, 0xAA, 0x53, 0xBF, 0x96,
+	    0x88, 0x5B, 0x40, 0xF4, 0x61, 0xCD, 0x76, 0xF5,
+	    0x5E, 0x4C, 0x4D, 0x20, 0x20, 0x3B, 0xE5, 0x8A,
+	    0x50, 0x43, 0xDB, 0xFB, 0x73, 0x74, 0x54, 0xE5 }, 48 },
+	{ { 0xC2, 0x1F, 0xCF, 0x38, 0x81, 0xCD, 0x5E, 0xE8,
+	    0x62, 0x8A, 0xCC, 0xB0, 0xA9, 0x89, 0x0D, 0xF8 }, 0, { 0 },
+	  { 0x3D, 0x02, 0xE0, 0xC7, 0x30, 0x55, 0x91, 0x12,
+	    0xB4, 0x73, 0xB7, 0x90, 0xDE, 0xE0, 0x18, 0xDF,
+	    0xCD, 0x6D, 0x73, 0x0C, 0xE5, 0x4E, 0x19, 0xF0,
+	    0xC3, 0x5E, 0xC4, 0x79, 0x0E, 0xB6, 0xC7, 0x4A }, 32 },
+	{ { 0x1D, 0x27, 0x2C, 0x6A, 0x2D, 0x8E, 0x3D, 0xFC,
+	    0xAC, 0x14, 0x05, 0x6B, 0x78, 0xD6, 0x33, 0xA0 }, 0, { 0 },
+	  { 0xA3, 0xA9, 0x7A, 0xBB, 0x80, 0x39, 0x38, 0x20,
+	    0xB7, 0xE5, 0x0C, 0x4A, 0xBB, 0x53, 0x82, 0x3D,
+	    0xC4, 0x42, 0x37, 0x99, 0xC2, 0xEF, 0xC9, 0xFF,
+	    0xB3, 0xA4, 0x12, 0x5F, 0x1F, 0x4C, 0x99, 0xA8 }, 32 },
+	{ { 0xC2, 0x1F, 0xCF, 0x38, 0x81, 0xCD, 0x5E, 0xE8,
+	    0x62, 0x8A, 0xCC, 0xB0, 0xA9, 0x89, 0x0D, 0xF8 },
+	  1, { 0x59, 0x7E, 0x26, 0xC1, 0x75, 0xF5, 0x73, 0xC3 },
+	  { 0xE3, 0x6C, 0x77, 0x64, 0xF3, 0x40, 0x36, 0x99,
+	    0xB7, 0xF7, 0x88, 0x6B, 0x0A, 0xB1, 0x85, 0x0C,
+	    0x9B, 0xD0, 0x7E, 0x2B, 0x13, 0xF3, 0x06, 0x48,
+	    0x87, 0xEE, 0xBA, 0x0F, 0x19, 0x7E, 0xA5, 0x25,
+	    0x9F, 0xD4, 0xD7, 0x93, 0x50, 0xDF, 0x4A, 0x41,
+	    0x0D, 0xEB, 0x4E, 0x74, 0x0C, 0x08, 0x44, 0x20 }, 48 },
+};
+
+#define NKEY_VECTORS	(sizeof(key_vectors) / sizeof(key_vectors[0]))
+
+// Contexts of the bulk setup: more than the sixteen lanes, plus a remainder
+#define NBULK		19
+
+// The vectors through the key setup, rabbit_crypt and rabbit_setup_bulk
+static void
+test_key_vectors(const char *backend)
+{
+	struct rabbit_context ctx, bulk[NBULK];
+	struct rabbit_master master;
+	uint8_t key[NBULK][16], iv[NBULK][8];
+	uint8_t zero[48] = { 0 }, out[48];
+	const struct key_vector *v;
+	size_t i;
+
+	for(i = 0; i < NKEY_VECTORS; i++) {
+		v = &key_vectors[i];
+
+		if(v->has_iv)
+			rabbit_set_key_and_iv(&ctx, v->key, 16, v->iv, 8);
+		else {
+			rabbit_key_setup(&master, v->key, 16);
+			rabbit_master_setup(&ctx, &master);
+		}
+
+		rabbit_crypt(&ctx, zero, v->len, out);
+		check("key vector", backend, out, v->out, v->len);
+	}
+
+	// Key only and key with an IV, in separate bulk calls
+	for(i = 0; i < NBULK; i++) {
+		memcpy(key[i], key_vectors[i % 3].key, 16);
+		memcpy(iv[i], key_vectors[3].iv, 8);
+	}
+
+	rabbit_setup_bulk(bulk, (const uint8_t (*)[16])key, NULL, NBULK);
+	for(i = 0; i < NBULK; i++) {
+		v = &key_vectors[i % 3];
+		rabbit_crypt(&bulk[i], zero, v->len, out);
+		check("rabbit_setup_bulk", backend, out, v->out, v->len);
+	}
+
+	for(i = 0; i < NBULK; i++)
+		memcpy(key[i], key_vectors[3].key, 16);
+
+	rabbit_setup_bulk(bulk, (const uint8_t (*)[16])key, (const uint8_t (*)[8])iv, NBULK);
+	for(i = 0; i < NBULK; i++) {
+		v = &key_vectors[3];
+		rabbit_crypt(&bulk[i], zero, v->len, out);
+		check("rabbit_setup_bulk with IV", backend, out, v->out, v->len);
+	}
+}
+
+/*
+ * The batch paths are checked against the serial path on the same
+ * data: a key, an IV and a length per stream, derived from its index.
+*/
+#define DATA		5000
+
+static uint8_t data[DATA];
+
+static void
+stream_key(size_t i, uint8_t key[16], uint8_t iv[8])
+{
+	memcpy(key, key_vectors[i % 3].key, 16);
+	memcpy(iv, key_vectors[3].iv, 8);
+	key[15] ^= i;
+	iv[0] ^= i * 7;
+}
+
+static size_t
+stream_len(size_t i)
+{
+	return (i * 1237 + i * i * 13) % (DATA - 1) + (i & 1);
+}
+
+// The serial path: rabbit_set_key_and_iv and rabbit_crypt
+static void
+serial_crypt(size_t i, const uint8_t *buf, size_t len, uint8_t *out)
+{
+	struct rabbit_context ctx;
+	uint8_t key[16], iv[8];
+
+	stream_key(i, key, iv);
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	rabbit_crypt(&ctx, buf, len, out);
+}
+
+#define MB_JOBS		40
+
+/*
+ * rabbit_mb_submit/flush over more jobs than lanes, two of them on one
+ * context, then the latency bound: 16, 4000 and 4000 bytes under 1 ms
+ * all come back from rabbit_mb_poll after 5 ms.
+*/
+static void
+test_mb(const char *backend)
+{
+	static struct rabbit_context ctx[MB_JOBS];
+	static uint8_t out[MB_JOBS][DATA], ref[2 * DATA];
+	static const uint32_t lat_len[3] = { 16, 4000, 4000 };
+	struct timespec ts = { 0, 5000000 };
+	struct rabbit_job job[MB_JOBS];
+	struct rabbit_mb_mgr *m;
+	uint8_t key[16], iv[8];
+	size_t i, len;
+	int n = 0;
+
+	if((m = rabbit_mb_new(0)) == NULL) {
+		printf("rabbit_mb_new (%s): FAIL\n", backend);
+		fails++;
+		return;
+	}
+
+	// Job MB_JOBS - 1 goes on after job MB_JOBS - 2, on its context
+	for(i = 0; i < MB_JOBS; i++) {
+		stream_key(i, key, iv);
+		rabbit_set_key_and_iv(&ctx[i], key, 16, iv, 8);
+
+		job[i].ctx = (i == MB_JOBS - 1) ? &ctx[i - 1] : &ctx[i];
+		job[i].buf = data;
+		job[i].buflen = stream_len(i);
+		job[i].out = out[i];
+
+		if(rabbit_mb_submit(m, &job[i]))
+			n++;
+	}
+
+	while(rabbit_mb_flush(m))
+		n++;
+
+	if(n != MB_JOBS) {
+		printf("rabbit_mb_submit (%s): FAIL, %d jobs of %d\n", backend, n, MB_JOBS);
+		fails++;
+	}
+
+	for(i = 0; i < MB_JOBS - 2; i++) {
+		serial_crypt(i, data, stream_len(i), ref);
+		check("rabbit_mb", backend, out[i], ref, stream_len(i));
+	}
+
+	// The two jobs of one context make one stream, block by block
+	len = stream_len(MB_JOBS - 2);
+	serial_crypt(MB_JOBS - 2, data, len, ref);
+	check("rabbit_mb same context", backend, out[MB_JOBS - 2], ref, len);
+
+	stream_key(MB_JOBS - 2, key, iv);
+	rabbit_set_key_and_iv(&ctx[0], key, 16, iv, 8);
+	rabbit_crypt(&ctx[0], data, len, ref);
+	rabbit_crypt(&ctx[0], data, stream_len(MB_JOBS - 1), ref + len);
+	check("rabbit_mb same context", backend, out[MB_JOBS - 1], ref + len, stream_len(MB_JOBS - 1));
+
+	rabbit_mb_free(m);
+
+	if((m = rabbit_mb_new(1000000)) == NULL) {
+		printf("rabbit_mb_new (%s): FAIL\n", backend);
+		fails++;
+		return;
+	}
+
+	for(i = 0, n = 0; i < 3; i++) {
+		stream_key(i, key, iv);
+		rabbit_set_key_and_iv(&ctx[i], key, 16, iv, 8);
+		job[i].ctx = &ctx[i];
+		job[i].buf = data;
+		job[i].buflen = lat_len[i];
+		job[i].out = out[i];
+
+		if(rabbit_mb_submit(m, &job[i]))
+			n++;
+	}
+
+	nanosleep(&ts, NULL);
+	for(i = 0; i < 100; i++)
+		if(rabbit_mb_poll(m))
+			n++;
+
+	if(n != 3) {
+		printf("rabbit_mb_poll (%s): FAIL, %d jobs of 3\n", backend, n);
+		fails++;
+	}
+
+	for(i = 0; i < 3; i++) {
+		serial_crypt(i, data, lat_len[i], ref);
+		check("rabbit_mb_poll", backend, out[i], ref, lat_len[i]);
+	}
+
+	while(rabbit_mb_flush(m))
+		;
+	rabbit_mb_free(m);
+}
+
+#define PACKETS		21
+
+// rabbit_crypt_packets: one key, an IV per packet
+static void
+test_packets(const char *backend)
+{
+	static uint8_t out[PACKETS][DATA], ref[DATA];
+	uint8_t key[16], k[16], iv[PACKETS][8];
+	const uint8_t *buf[PACKETS];
+	uint8_t *dst[PACKETS];
+	uint32_t buflen[PACKETS];
+	struct rabbit_context ctx;
+	struct rabbit_master master;
+	size_t i;
+
+	for(i = 0; i < PACKETS; i++) {
+		stream_key(i, k, iv[i]);
+		buf[i] = data;
+		buflen[i] = stream_len(i);
+		dst[i] = out[i];
+	}
+	stream_key(0, key, iv[0]);
+
+	rabbit_key_setup(&master, key, 16);
+	rabbit_crypt_packets(&master, (const uint8_t (*)[8])iv, buf, buflen, dst, PACKETS);
+
+	for(i = 0; i < PACKETS; i++) {
+		rabbit_set_key_and_iv(&ctx, key, 16, iv[i], 8);
+		rabbit_crypt(&ctx, buf[i], buflen[i], ref);
+		check("rabbit_crypt_packets", backend, out[i], ref, buflen[i]);
+	}
+}
+
+/*
+ * rabbit_crypt_sectors: sector s under the IV base_iv + s, the base IV
+ * close to 2^64 so the sector numbers wrap around
+*/
+static void
+test_sectors(const char *backend)
+{
+	static const uint8_t base_iv[8] = { 0xFD, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	static const uint32_t sector_size[2] = { 512, 300 };
+	static uint8_t out[DATA], ref[DATA];
+	struct rabbit_context sctx;
+	struct rabbit_master master;
+	uint8_t key[16], iv[8];
+	uint64_t sector, n;
+	size_t off, len;
+	int i, j;
+
+	stream_key(5, key, iv);
+	rabbit_key_setup(&master, key, 16);
+
+	for(i = 0; i < 2; i++) {
+		if(rabbit_crypt_sectors(&master, base_iv, 1, sector_size[i], data, DATA, out)) {
+			printf("rabbit_crypt_sectors (%s): FAIL\n", backend);
+			fails++;
+			continue;
+		}
+
+		for(off = 0, sector = 1; off < DATA; off += len, sector++) {
+			len = (DATA - off < sector_size[i]) ? DATA - off : sector_size[i];
+
+			n = sector;
+			for(j = 0; j < 8; j++) {
+				n += base_iv[j];
+				iv[j] = n;
+				n >>= 8;
+			}
+
+			rabbit_set_key_and_iv(&sctx, key, 16, iv, 8);
+			rabbit_crypt(&sctx, data + off, len, ref + off);
+		}
+
+		check("rabbit_crypt_sectors", backend, out, ref, DATA);
+	}
+
+	if(rabbit_crypt_sectors(&master, base_iv, 0, 0, data, DATA, out) != -1) {
+		printf("rabbit_crypt_sectors zero size (%s): FAIL\n", backend);
+		fails++;
+	}
+}
+
+#define POOL_JOBS	50
+
+// rabbit_pool_crypt with four threads and with the calling thread alone
+static void
+test_pool(const char *backend)
+{
+	static struct rabbit_context ctx[POOL_JOBS];
+	static uint8_t out[POOL_JOBS][DATA], ref[DATA];
+	static const int nthreads[2] = { 4, 1 };
+	struct rabbit_pool_job job[POOL_JOBS];
+	struct rabbit_pool *p;
+	uint8_t key[16], iv[8];
+	size_t i;
+	int t;
+
+	for(t = 0; t < 2; t++) {
+		if((p = rabbit_pool_new(nthreads[t])) == NULL) {
+			printf("rabbit_pool_new (%s): FAIL\n", backend);
+			fails++;
+			continue;
+		}
+
+		for(i = 0; i < POOL_JOBS; i++) {
+			stream_key(i, key, iv);
+			rabbit_set_key_and_iv(&ctx[i], key, 16, iv, 8);
+			job[i].ctx = &ctx[i];
+			job[i].buf = data;
+			job[i].buflen = stream_len(i);
+			job[i].out = out[i];
+		}
+
+		rabbit_pool_crypt(p, job, POOL_JOBS);
+
+		for(i = 0; i < POOL_JOBS; i++) {
+			serial_crypt(i, data, stream_len(i), ref);
+			check("rabbit_pool_crypt", backend, out[i], ref, stream_len(i));
+		}
+
+		rabbit_pool_free(p);
+	}
+}
+
+/*
+ * rabbit_cryptv in two calls, with the input and the output fragments
+ * cut differently (empty ones included), then in place, against one
+ * rabbit_crypt over the whole data
+*/
+static void
+test_cryptv(const char *backend)
+{
+	static const size_t in_cut[] = { 0, 1, 17, 0, 983, 1000, 1, 999, 2000 - 1 };
+	static const size_t out_cut[] = { 5, 0, 13, 3987, 995 };
+	static uint8_t out[DATA], ref[DATA];
+	struct iovec in[9], outv[5];
+	struct rabbit_context ctx;
+	uint8_t key[16], iv[8];
+	size_t i, off;
+	int ret;
+
+	for(i = 0, off = 0; i < 9; off += in_cut[i], i++) {
+		in[i].iov_base = data + off;
+		in[i].iov_len = in_cut[i];
+	}
+	for(i = 0, off = 0; i < 5; off += out_cut[i], i++) {
+		outv[i].iov_base = out + off;
+		outv[i].iov_len = out_cut[i];
+	}
+
+	serial_crypt(7, data, DATA, ref);
+
+	// The first call takes 18 bytes, the second one the rest
+	stream_key(7, key, iv);
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	ret = rabbit_cryptv(&ctx, in, 4, outv, 3);
+	ret |= rabbit_cryptv(&ctx, in + 4, 5, outv + 3, 2);
+
+	if(ret) {
+		printf("rabbit_cryptv (%s): FAIL\n", backend);
+		fails++;
+	} else
+		check("rabbit_cryptv", backend, out, ref, DATA);
+
+	// In place, the input fragments as the output ones
+	memcpy(out, data, DATA);
+	for(i = 0, off = 0; i < 9; off += in_cut[i], i++)
+		in[i].iov_base = out + off;
+
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	if(rabbit_cryptv(&ctx, in, 9, in, 9)) {
+		printf("rabbit_cryptv in place (%s): FAIL\n", backend);
+		fails++;
+	} else
+		check("rabbit_cryptv in place", backend, out, ref, DATA);
+
+	// A short output is refused, nothing is crypted
+	memcpy(out, data, DATA);
+	if(rabbit_cryptv(&ctx, in, 9, in, 8) != -1) {
+		printf("rabbit_cryptv short output (%s): FAIL\n", backend);
+		fails++;
+	} else
+		check("rabbit_cryptv short output", backend, out, data, DATA);
+}
+
+/*
+ * rabbit_skip(n) then rabbit_crypt against the tail of one rabbit_crypt
+ * over n blocks more, then a snapshot with a leftover restored into
+ * another context, and the snapshots rabbit_restore must reject
+*/
+static void
+test_skip_snapshot(const char *backend)
+{
+	static const uint64_t nskip[7] = { 0, 1, 2, 5, 64, 65, 200 };
+	static const size_t len[6] = { 0, 1, 15, 16, 17, 1000 };
+	// Bad magic, unknown version, carry above 1, nleft above 16
+	static const int bad_at[4] = { 1, 3, 68, 72 };
+	static const uint8_t bad_byte[4] = { 'X', RABBIT_SNAPSHOT_VERSION + 1, 2, 17 };
+	static uint8_t out[DATA], ref[DATA];
+	uint8_t snap[RABBIT_SNAPSHOT_SIZE], bad[RABBIT_SNAPSHOT_SIZE];
+	struct rabbit_context ctx, sctx, keep;
+	uint8_t key[16], iv[8];
+	int i, j;
+
+	stream_key(4, key, iv);
+
+	for(i = 0; i < 7; i++)
+		for(j = 0; j < 6; j++) {
+			rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+			rabbit_skip(&ctx, nskip[i]);
+			rabbit_crypt(&ctx, data, len[j], out);
+
+			rabbit_set_key_and_iv(&sctx, key, 16, iv, 8);
+			memset(ref, 0, nskip[i] * 16);
+			memcpy(ref + nskip[i] * 16, data, len[j]);
+			rabbit_crypt(&sctx, ref, nskip[i] * 16 + len[j], ref);
+			check("rabbit_skip", backend, out, ref + nskip[i] * 16, len[j]);
+		}
+
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	rabbit_crypt_stream(&ctx, data, 37, out);
+	rabbit_snapshot(&ctx, snap);
+	rabbit_crypt_stream(&ctx, data, 500, ref);
+
+	memset(&sctx, 0x5A, sizeof(sctx));
+	if(rabbit_restore(&sctx, snap)) {
+		printf("rabbit_restore (%s): FAIL\n", backend);
+		fails++;
+	}
+	rabbit_snapshot(&sctx, bad);
+	check("rabbit_snapshot", backend, bad, snap, RABBIT_SNAPSHOT_SIZE);
+	rabbit_crypt_stream(&sctx, data, 500, out);
+	check("rabbit_restore", backend, out, ref, 500);
+
+	// The context is left as it was
+	for(i = 0; i < 4; i++) {
+		memcpy(bad, snap, sizeof(bad));
+		bad[bad_at[i]] = bad_byte[i];
+		keep = sctx;
+		if(rabbit_restore(&sctx, bad) != -1 || memcmp(&keep, &sctx, sizeof(keep))) {
+			printf("rabbit_restore bad snapshot %d (%s): FAIL\n", i, backend);
+			fails++;
+		}
+	}
+}
+
+/*
+ * The tiled path of rabbit_crypt, forced with a threshold of one tile,
+ * against the fused kernel at every misalignment of buf and out,
+ * out of place and in place
+*/
+static void
+test_crypt_tiled(const char *backend)
+{
+	static uint8_t out[DATA + 16], ref[DATA];
+	struct rabbit_context ctx;
+	uint8_t key[16], iv[8];
+	size_t len;
+	int o;
+
+	stream_key(6, key, iv);
+
+	for(o = 1; o < 16; o++) {
+		len = DATA - 16 - o;
+
+		rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+		rabbit_crypt(&ctx, data + o, len, ref);
+
+		rabbit_llc_set(RABBIT_TILE);
+
+		rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+		rabbit_crypt(&ctx, data + o, len, out + 16 - o);
+		check("rabbit_crypt tiled", backend, out + 16 - o, ref, len);
+
+		memcpy(out + o, data + o, len);
+		rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+		rabbit_crypt(&ctx, out + o, len, out + o);
+		check("rabbit_crypt tiled in place", backend, out + o, ref, len);
+
+		rabbit_llc_set(0);
+	}
+}
+
+#define CHUNK_ROUNDS	20
+
+/*
+ * rabbit_crypt_stream over random chunkings of the data against one
+ * rabbit_crypt call. A quarter of the chunks are 0 or 1 byte long,
+ * the others cross the leftover keystream and the whole blocks.
+*/
+static void
+test_crypt_stream(const char *backend)
+{
+	// Upper bounds of the chunk lengths, picked at random
+	static const int chunk_max[4] = { 2, 16, 100, 700 };
+	static uint8_t out[DATA], ref[DATA];
+	struct rabbit_context ctx;
+	uint8_t key[16], iv[8];
+	size_t pos, n;
+	int round, r;
+
+	stream_key(7, key, iv);
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	rabbit_crypt(&ctx, data, DATA, ref);
+
+	srand(1);
+
+	for(round = 0; round < CHUNK_ROUNDS; round++) {
+		rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+
+		for(pos = 0; pos < DATA; pos += n) {
+			r = rand();
+			n = (r >> 2) % chunk_max[r & 3];
+			if(n > DATA - pos)
+				n = DATA - pos;
+
+			rabbit_crypt_stream(&ctx, data + pos, n, out + pos);
+		}
+
+		check("rabbit_crypt_stream", backend, out, ref, DATA);
+	}
+}
+
+#define INLINE_LENS	66
+
+/*
+ * The inline fast path against rabbit_set_key_and_iv and rabbit_crypt,
+ * for every length up to 64 bytes plus one: the short branches up to
+ * RABBIT_INLINE_MAX and the rabbit_crypt fallback past it. The context
+ * variant runs twice, the second call goes on from the first one.
+*/
+static void
+test_inline(const char *backend)
+{
+	uint8_t key[16], iv[8], out[2 * INLINE_LENS], ref[2 * INLINE_LENS];
+	struct rabbit_context ctx;
+	struct rabbit_master m;
+	size_t len;
+
+	stream_key(8, key, iv);
+	rabbit_key_setup(&m, key, 16);
+
+	for(len = 0; len < INLINE_LENS; len++) {
+		rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+		rabbit_crypt(&ctx, data, len, ref);
+		rabbit_crypt(&ctx, data + len, len, ref + len);
+
+		rabbit_inline_set_key_and_iv(&ctx, key, iv);
+		rabbit_inline_crypt(&ctx, data, len, out);
+		rabbit_inline_crypt(&ctx, data + len, len, out + len);
+		check("rabbit_inline_crypt", backend, out, ref, 2 * len);
+
+		memset(out, 0, len);
+		rabbit_inline_crypt_master(&m, iv, data, len, out);
+		check("rabbit_inline_crypt_master", backend, out, ref, len);
+
+		memset(out, 0, len);
+		rabbit_inline_crypt_once(key, iv, data, len, out);
+		check("rabbit_inline_crypt_once", backend, out, ref, len);
+	}
+}
+
+#define RNG_TOTAL	(4 * DATA)
+
+/*
+ * rabbit_keystream against rabbit_crypt of zeros, into an aligned and
+ * an unaligned out, over two calls. Then rabbit_rng_bytes requests of
+ * random sizes, from 0 bytes to past two pools, against one
+ * rabbit_keystream: the pool, its refills and the direct path must
+ * give the keystream in order.
+*/
+static void
+test_keystream(const char *backend)
+{
+	static const size_t len[7] = { 0, 1, 15, 16, 17, 1000, DATA - 1 };
+	static const int offset[3] = { 0, 1, 7 };
+	// Upper bounds of the request sizes, picked at random
+	static const int request_max[4] = { 17, 300, 1100, 2 * RABBIT_RNG_POOL + 40 };
+	static uint8_t zero[DATA], out[RNG_TOTAL + 16] __attribute__((aligned(64))), ref[RNG_TOTAL];
+	struct rabbit_context ctx, kctx;
+	struct rabbit_rng rng;
+	uint8_t key[16], iv[8];
+	size_t pos, n;
+	int i, j, r;
+
+	stream_key(9, key, iv);
+
+	for(i = 0; i < 7; i++)
+		for(j = 0; j < 3; j++) {
+			rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+			rabbit_crypt(&ctx, zero, len[i], ref);
+			rabbit_crypt(&ctx, zero, len[i], ref + len[i]);
+
+			rabbit_set_key_and_iv(&kctx, key, 16, iv, 8);
+			rabbit_keystream(&kctx, out + offset[j], len[i]);
+			rabbit_keystream(&kctx, out + offset[j] + len[i], len[i]);
+			check("rabbit_keystream", backend, out + offset[j], ref, 2 * len[i]);
+		}
+
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	rabbit_keystream(&ctx, ref, RNG_TOTAL);
+
+	rabbit_rng_init(&rng, key, iv);
+	srand(2);
+
+	for(pos = 0; pos < RNG_TOTAL; pos += n) {
+		r = rand();
+		n = (r >> 2) % request_max[r & 3];
+		if(n > RNG_TOTAL - pos)
+			n = RNG_TOTAL - pos;
+
+		rabbit_rng_bytes(&rng, out + pos, n);
+	}
+
+	check("rabbit_rng_bytes", backend, out, ref, RNG_TOTAL);
+	rabbit_rng_wipe(&rng);
+}
+
+#define DRAWS	100000
+
+/*
+ * Typed draws of the generator: floats and doubles against their
+ * mapping from the keystream words, bounded draws in range (bound 1,
+ * the whole range of bound 0, half of the draws rejected at 2^31 + 1),
+ * substreams against an IV of the id, and the mean and variance of
+ * the normal draws.
+*/
+static void
+test_distributions(const char *backend)
+{
+	static const uint32_t bound[5] = { 1, 0, 0x80000001, 7, 1000 };
+	static uint32_t w32[DRAWS], u[DRAWS];
+	static uint64_t w64[DRAWS];
+	static float f[DRAWS];
+	static double d[DRAWS];
+	struct rabbit_context ctx;
+	struct rabbit_rng rng, sub;
+	uint8_t key[16], iv[8], a[100], b[100];
+	uint64_t id = 0x0123456789ABCDEFULL;
+	double mean, var, expected;
+	size_t i;
+	int j, bad;
+
+	stream_key(10, key, iv);
+
+	rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+	rabbit_keystream(&ctx, (uint8_t *)w32, sizeof(w32));
+	rabbit_rng_init(&rng, key, iv);
+	rabbit_rng_float(&rng, f, DRAWS);
+
+	for(i = bad = 0; i < DRAWS; i++)
+		bad |= f[i] != (float)(w32[i] >> 8) * 0x1p-24f || f[i] < 0.0f || f[i] >= 1.0f;
+
+	rabbit_rng_double(&rng, d, DRAWS);
+	rabbit_keystream(&ctx, (uint8_t *)w64, sizeof(w64));
+
+	for(i = 0; i < DRAWS; i++)
+		bad |= d[i] != (double)(w64[i] >> 11) * 0x1p-53 || d[i] < 0.0 || d[i] >= 1.0;
+
+	if(bad) {
+		printf("rabbit_rng_float/double (%s): FAIL\n", backend);
+		fails++;
+	}
+
+	for(j = 0; j < 5; j++) {
+		rabbit_rng_bounded(&rng, u, DRAWS, bound[j]);
+
+		for(i = bad = 0, mean = 0; i < DRAWS; i++) {
+			bad |= bound[j] && u[i] >= bound[j];
+			mean += bound[j] ? (double)u[i] / bound[j] : u[i] * 0x1p-32;
+		}
+		mean /= DRAWS;
+
+		// The mean of u / bound is (bound - 1) / (2 * bound)
+		expected = bound[j] ? (bound[j] - 1.0) / (2.0 * bound[j]) : 0.5;
+		if(bad || fabs(mean - expected) > 0.01) {
+			printf("rabbit_rng_bounded %u (%s): FAIL\n", bound[j], backend);
+			fails++;
+		}
+	}
+
+	// Substream id: the key of the base, the IV id in little-endian
+	for(j = 0; j < 8; j++)
+		iv[j] = id >> (8 * j);
+	rabbit_rng_substream(&sub, &rng, id);
+	rabbit_rng_bytes(&sub, a, sizeof(a));
+	rabbit_rng_init(&rng, key, iv);
+	rabbit_rng_bytes(&rng, b, sizeof(b));
+	check("rabbit_rng_substream", backend, a, b, sizeof(a));
+
+	rabbit_rng_normal(&rng, d, DRAWS, 3.0, 2.0);
+
+	for(i = 0, mean = 0; i < DRAWS; i++)
+		mean += d[i];
+	mean /= DRAWS;
+	for(i = 0, var = 0; i < DRAWS; i++)
+		var += (d[i] - mean) * (d[i] - mean);
+	var /= DRAWS - 1;
+
+	// About 8 and 5 standard errors
+	if(fabs(mean - 3.0) > 0.05 || fabs(var - 4.0) > 0.1) {
+		printf("rabbit_rng_normal (%s): FAIL\n", backend);
+		fails++;
+	}
+
+	rabbit_rng_wipe(&rng);
+	rabbit_rng_wipe(&sub);
+}
+
+#define CRC_LENS	40
+
+/*
+ * CRC32C: the check value of "123456789", then the fused crypt against
+ * rabbit_crypt_stream and rabbit_crc32c of the ciphertext, encrypt and
+ * decrypt, at unaligned offsets and in two chunks. Every implementation
+ * must give the CRCs of the first one (the table).
+*/
+static void
+test_crc32c(const char *backend)
+{
+	static const char *impl[2] = { "table", "sse42" };
+	static uint8_t out[DATA], ref[DATA];
+	static uint32_t crcs[CRC_LENS][3];
+	struct rabbit_context ctx, sctx;
+	uint8_t key[16], iv[8];
+	uint32_t crc[3];
+	size_t len, off, cut;
+	int i, k, mode;
+
+	stream_key(9, key, iv);
+
+	for(i = 0; i < 2; i++) {
+		if(rabbit_crc32c_select(impl[i]))
+			continue;
+
+		if(rabbit_crc32c(0, "123456789", 9) != 0xE3069283 ||
+		    rabbit_crc32c(rabbit_crc32c(0, "1234", 4), "56789", 5) != 0xE3069283) {
+			printf("rabbit_crc32c %s (%s): FAIL\n", impl[i], backend);
+			fails++;
+		}
+
+		for(k = 0; k < CRC_LENS; k++) {
+			off = k % 8;
+			len = (k * k * 131 + k * 7) % (DATA - 8);
+			cut = (k % 3) ? len / 3 : 0;
+
+			rabbit_set_key_and_iv(&sctx, key, 16, iv, 8);
+			rabbit_crypt_stream(&sctx, data + off, len, ref);
+			crc[0] = rabbit_crc32c(0, data + off, len);
+
+			// encrypt: the CRC of out, decrypt: the CRC of buf
+			for(mode = 0; mode < 2; mode++) {
+				rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+				crc[1 + mode] = rabbit_crypt_stream_crc32c(&ctx, (mode ? ref : data + off), cut,
+					out, 0, mode);
+				crc[1 + mode] = rabbit_crypt_stream_crc32c(&ctx, (mode ? ref : data + off) + cut,
+					len - cut, out + cut, crc[1 + mode], mode);
+				check("rabbit_crypt_stream_crc32c", backend, out, mode ? data + off : ref, len);
+			}
+
+			if(crc[1] != rabbit_crc32c(0, ref, len) || crc[2] != crc[1] ||
+			    (i && memcmp(crc, crcs[k], sizeof(crc)))) {
+				printf("rabbit_crypt_stream_crc32c %s (%s): FAIL\n", impl[i], backend);
+				fails++;
+			}
+			memcpy(crcs[k], crc, sizeof(crc));
+		}
+	}
+
+	rabbit_crc32c_select("auto");
+}
+
+#define RING_CHUNKS	80
+
+/*
+ * rabbit_ring_crypt in chunks of 0 to 4999 bytes against
+ * rabbit_crypt_stream, on a stream with a leftover, with a two-tile
+ * ring (chunks longer than the ring, the consumer crypts on a dry
+ * ring) and a deeper one given time to fill up. The stream given back
+ * by rabbit_ring_free goes on like the reference.
+*/
+static void
+test_ring(const char *backend)
+{
+	static const size_t depth[2] = { 0, 64 * 1024 };
+	static uint8_t out[DATA], ref[DATA];
+	const struct timespec fill = { 0, 2000000 };
+	struct rabbit_context ctx, sctx;
+	struct rabbit_ring *r;
+	uint8_t key[16], iv[8];
+	size_t len;
+	int i, k;
+
+	for(i = 0; i < 2; i++) {
+		stream_key(i + 3, key, iv);
+		rabbit_set_key_and_iv(&ctx, key, 16, iv, 8);
+		rabbit_crypt_stream(&ctx, data, 5, out);
+		sctx = ctx;
+
+		if((r = rabbit_ring_new(&ctx, depth[i])) == NULL) {
+			printf("rabbit_ring_new (%s): FAIL\n", backend);
+			fails++;
+			continue;
+		}
+
+		for(k = 0; k < RING_CHUNKS; k++) {
+			if(k % 20 == 10)
+				nanosleep(&fill, NULL);
+
+			len = (k % 7 == 0) ? 0 : (k % 11 == 3) ? 1 : (k * k * 37 + k * 101) % DATA;
+			rabbit_ring_crypt(r, data, len, out);
+			rabbit_crypt_stream(&sctx, data, len, ref);
+			check("rabbit_ring_crypt", backend, out, ref, len);
+		}
+
+		rabbit_ring_free(r, &ctx);
+		rabbit_crypt_stream(&ctx, data, 100, out);
+		rabbit_crypt_stream(&sctx, data, 100, ref);
+		check("rabbit_ring_free", backend, out, ref, 100);
+	}
+}
+
+/*
+ * rabbit_crypt_x8/x16 against rabbit_crypt lane by lane, twice so the
+ * states written back are checked too. The lengths all differ and are
+ * not whole blocks, the longest one runs far past the others.
+*/
+static void
+test_crypt_lanes(const char *name, const char *backend, int lanes,
+	void (*crypt)(struct rabbit_context **, const uint8_t **, const uint32_t *, uint8_t **))
+{
+	static uint8_t out[16][DATA], ref[DATA];
+	struct rabbit_context ctx[16], sctx[16], *cp[16];
+	const uint8_t *buf[16];
+	uint8_t *dst[16];
+	uint32_t buflen[16];
+	uint8_t key[16], iv[8];
+	int i, round;
+
+	for(i = 0; i < lanes; i++) {
+		stream_key(i + 20, key, iv);
+		rabbit_set_key_and_iv(&ctx[i], key, 16, iv, 8);
+		sctx[i] = ctx[i];
+		cp[i] = &ctx[i];
+		buflen[i] = 1 + i * 151 + (i * i * 29) % 97;
+		if(buflen[i] % 16 == 0)
+			buflen[i]++;
+		buf[i] = data + i;
+		dst[i] = out[i];
+	}
+	buflen[lanes - 1] = DATA - 19;
+
+	for(round = 0; round < 2; round++) {
+		crypt(cp, buf, buflen, dst);
+
+		for(i = 0; i < lanes; i++) {
+			rabbit_crypt(&sctx[i], buf[i], buflen[i], ref);
+			check(name, backend, out[i], ref, buflen[i]);
+		}
+	}
+}
+
+#define SESSIONS	(RABBIT_SLAB_SESSIONS + 300)
+#define SESSION_BATCH	512
+#define SESSION_LEN	200
+
+static uint64_t
+session_id(size_t i)
+{
+	return i * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+/*
+ * A rabbit_session_crypt_batch pass over every live session, each one
+ * twice per batch, against rabbit_crypt on the contexts of ref
+*/
+static void
+session_pass(struct rabbit_session_table *t, struct rabbit_context *ref,
+	const uint8_t *live, const char *backend)
+{
+	static uint8_t out[SESSION_BATCH][SESSION_LEN], expected[SESSION_LEN];
+	uint64_t id[SESSION_BATCH];
+	const uint8_t *buf[SESSION_BATCH];
+	uint8_t *dst[SESSION_BATCH];
+	uint32_t buflen[SESSION_BATCH];
+	size_t b, k, n, s[SESSION_BATCH];
+
+	for(b = 0; b * (SESSION_BATCH / 2) < SESSIONS; b++) {
+		for(k = n = 0; k < SESSION_BATCH; k++) {
+			s[n] = (b * (SESSION_BATCH / 2) + k % (SESSION_BATCH / 2)) * 7919 % SESSIONS;
+			if(!live[s[n]])
+				continue;
+
+			id[n] = session_id(s[n]);
+			buf[n] = data + k;
+			buflen[n] = (s[n] * 37 + k) % SESSION_LEN;
+			dst[n] = out[n];
+			n++;
+		}
+
+		if(rabbit_session_crypt_batch(t, id, buf, buflen, dst, n)) {
+			printf("rabbit_session_crypt_batch (%s): FAIL\n", backend);
+			fails++;
+			return;
+		}
+
+		for(k = 0; k < n; k++) {
+			rabbit_crypt(&ref[s[k]], buf[k], buflen[k], expected);
+			check("rabbit_session_crypt_batch", backend, out[k], expected, buflen[k]);
+		}
+	}
+}
+
+/*
+ * The session table over more than one slab: add, batches, single
+ * crypts, remove every third session (the probe chains then cross
+ * deleted entries), add them back under new keys, batches again
+*/
+static void
+test_sessions(const char *backend)
+{
+	static struct rabbit_context ref[SESSIONS];
+	static uint8_t live[SESSIONS];
+	uint8_t key[16], iv[8], out[SESSION_LEN], expected[SESSION_LEN];
+	struct rabbit_session_table *t;
+	size_t i;
+
+	if((t = rabbit_session_table_new(16)) == NULL) {
+		printf("rabbit_session_table_new (%s): FAIL\n", backend);
+		fails++;
+		return;
+	}
+
+	for(i = 0; i < SESSIONS; i++) {
+		stream_key(i, key, iv);
+		rabbit_set_key_and_iv(&ref[i], key, 16, iv, 8);
+		live[i] = rabbit_session_add(t, session_id(i), key, 16, iv, 8) == 0;
+		if(!live[i]) {
+			printf("rabbit_session_add (%s): FAIL\n", backend);
+			fails++;
+		}
+	}
+
+	if(rabbit_session_add(t, session_id(3), key, 16, iv, 8) != -1) {
+		printf("rabbit_session_add twice (%s): FAIL\n", backend);
+		fails++;
+	}
+
+	session_pass(t, ref, live, backend);
+
+	for(i = 0; i < SESSIONS; i += 3) {
+		if(rabbit_session_remove(t, session_id(i))) {
+			printf("rabbit_session_remove (%s): FAIL\n", backend);
+			fails++;
+		}
+		live[i] = 0;
+	}
+
+	if(rabbit_session_count(t) != SESSIONS - (SESSIONS + 2) / 3 ||
+	    rabbit_session_remove(t, session_id(0)) != -1 ||
+	    rabbit_session_crypt(t, session_id(0), data, 16, out) != -1) {
+		printf("rabbit_session_remove (%s): FAIL\n", backend);
+		fails++;
+	}
+
+	// The others are still found past the deleted entries
+	for(i = 1; i < SESSIONS; i += 3) {
+		if(rabbit_session_crypt(t, session_id(i), data, SESSION_LEN, out)) {
+			printf("rabbit_session_crypt (%s): FAIL\n", backend);
+			fails++;
+			continue;
+		}
+		rabbit_crypt(&ref[i], data, SESSION_LEN, expected);
+		check("rabbit_session_crypt", backend, out, expected, SESSION_LEN);
+	}
+
+	for(i = 0; i < SESSIONS; i += 3) {
+		stream_key(i + 11, key, iv);
+		rabbit_set_key_and_iv(&ref[i], key, 16, iv, 8);
+		live[i] = rabbit_session_add(t, session_id(i), key, 16, iv, 8) == 0;
+		if(!live[i]) {
+			printf("rabbit_session_add again (%s): FAIL\n", backend);
+			fails++;
+		}
+	}
+
+	session_pass(t, ref, live, backend);
+
+	if(rabbit_session_count(t) != SESSIONS) {
+		printf("rabbit_session_count (%s): FAIL\n", backend);
+		fails++;
+	}
+
+	rabbit_session_table_free(t);
+}
+
+// RFC 8439 2.5.2
+static void
+test_poly1305(void)
+{
+	static const uint8_t key[32] = {
+		0x85, 0xD6, 0xBE, 0x78, 0x57, 0x55, 0x6D, 0x33,
+		0x7F, 0x44, 0x52, 0xFE, 0x42, 0xD5, 0x06, 0xA8,
+		0x01, 0x03, 0x80, 0x8A, 0xFB, 0x0D, 0xB2, 0xFD,
+		0x4A, 0xBF, 0xF6, 0xAF, 0x41, 0x49, 0xF5, 0x1B };
+	static const uint8_t expected[16] = {
+		0xA8, 0x06, 0x1D, 0xC1, 0x30, 0x51, 0x36, 0xC6,
+		0xC2, 0x2B, 0x8B, 0xAF, 0x0C, 0x01, 0x27, 0xA9 };
+	const char *m = "Cryptographic Forum Research Group";
+	uint8_t tag[16];
+
+	rabbit_poly1305(tag, key, (const uint8_t *)m, strlen(m));
+	check("Poly1305", "RFC 8439", tag, expected, 16);
+}
+
+/*
+ * Seal of a fixed message under the RFC 4503 A.1 key and the IV above.
+ * ct and tag come from the eSTREAM reference keystream and a separate
+ * Poly1305 over aad || pad16 || ct || pad16 || le64(12) || le64(40).
+*/
+static void
+test_aead(const char *backend)
+{
+	static const uint8_t iv[8] = { 0x59, 0x7E, 0x26, 0xC1, 0x75, 0xF5, 0x73, 0xC3 };
+	static const uint8_t aad[12] = {
+		0x50, 0x51, 0x52, 0x53, 0xC0, 0xC1, 0xC2, 0xC3,
+		0xC4, 0xC5, 0xC6, 0xC7 };
+	static const uint8_t ct[40] = {
+		0x26, 0x5C, 0x0C, 0x4B, 0x0A, 0x32, 0xE5, 0x97,
+		0xEF, 0x05, 0xBF, 0xBF, 0x21, 0x3D, 0x0B, 0x00,
+		0x56, 0xA7, 0x60, 0x41, 0xA0, 0x91, 0x27, 0x17,
+		0xAD, 0xC7, 0x3E, 0x7F, 0x3C, 0x98, 0xFB, 0x01,
+		0x06, 0x74, 0x65, 0x60, 0x53, 0x7D, 0x42, 0x43 };
+	static const uint8_t expected_tag[16] = {
+		0x08, 0xF8, 0x4B, 0x6F, 0x6F, 0x10, 0x61, 0x1E,
+		0x6A, 0x41, 0xF0, 0x95, 0x87, 0x8C, 0x22, 0xE5 };
+	const uint8_t *pt = (const uint8_t *)"Ladies and Gentlemen of the class of '99";
+	struct rabbit_master master;
+	uint8_t out[40], tag[16];
+
+	rabbit_key_setup(&master, key_vectors[0].key, 16);
+
+	rabbit_aead_seal(&master, iv, aad, sizeof(aad), pt, 40, out, tag);
+	check("rabbit_aead_seal", backend, out, ct, 40);
+	check("rabbit_aead_seal tag", backend, tag, expected_tag, 16);
+
+	if(rabbit_aead_open(&master, iv, aad, sizeof(aad), ct, 40, expected_tag, out)) {
+		printf("rabbit_aead_open (%s): FAIL\n", backend);
+		fails++;
+	} else
+		check("rabbit_aead_open", backend, out, pt, 40);
+}
 
 int
 main(void)
@@ -24,21 +1145,58 @@ main(void)
 			   0x75, 0xF5, 0x73, 0xC3 };
 	
 	struct rabbit_context ctx;
+	size_t i;
 
 	if(rabbit_set_key_and_iv(&ctx, key1, 16, iv1, 8)) {
 		printf("Rabbit context filling error!\n");
 		exit(1);
 	}
 	
-	rabbit_test_vectors(&ctx);
+	rabbit_test_vectors_key(&ctx, key1, iv1);
 
 	if(rabbit_set_key_and_iv(&ctx, key2, 16, iv2, 8)) {
 		printf("Rabbit context filling error!\n");
 		exit(1);
 	}
 	
-	rabbit_test_vectors(&ctx);
+	rabbit_test_vectors_key(&ctx, key2, iv2);
+
+	for(i = 0; i < DATA; i++)
+		data[i] = i * 13 + 5;
+
+	test_poly1305();
+
+	// The runtime checks, on every backend the CPU has
+	for(i = 0; i < NBACKENDS; i++) {
+		if(rabbit_backend_select(backends[i]))
+			continue;
+
+		test_key_vectors(backends[i]);
+		test_aead(backends[i]);
+		test_mb(backends[i]);
+		test_packets(backends[i]);
+		test_sectors(backends[i]);
+		test_pool(backends[i]);
+		test_cryptv(backends[i]);
+		test_crypt_stream(backends[i]);
+		test_sessions(backends[i]);
+		test_ring(backends[i]);
+		test_crc32c(backends[i]);
+		test_skip_snapshot(backends[i]);
+		test_crypt_tiled(backends[i]);
+		test_inline(backends[i]);
+		test_keystream(backends[i]);
+		test_distributions(backends[i]);
+
+		if(__builtin_cpu_supports("avx2"))
+			test_crypt_lanes("rabbit_crypt_x8", backends[i], 8, rabbit_crypt_x8);
+		if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+		    __builtin_cpu_supports("avx512vl"))
+			test_crypt_lanes("rabbit_crypt_x16", backends[i], 16, rabbit_crypt_x16);
+	}
+
+	printf("\nRuntime checks: %s\n", fails ? "FAIL" : "OK");
 
-	return 0;
+	return fails ? 1 : 0;
 }
 
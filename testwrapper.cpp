@@ -0,0 +1,242 @@
+/*
+ * Test of the C++ interface: every method and batch template of
+ * rabbit.hpp against the C calls on the same data, then every backend
+ * against the compile-time core of rabbit_constexpr.hpp.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <array>
+#include <utility>
+
+#include "rabbit.hpp"
+#include "rabbit_constexpr.hpp"
+
+#define LEN	5000
+
+// Keystream bytes and streams of the constexpr cross-check
+#define KS		1000
+#define NSTREAMS	20
+
+static std::byte in[LEN], a[LEN], b[LEN];
+
+static int
+check(const char *name, const void *x, const void *y, std::size_t len)
+{
+	if(std::memcmp(x, y, len) == 0)
+		return 0;
+
+	printf("%s: FAIL\n", name);
+	return 1;
+}
+
+static const uint8_t *
+u8(const std::byte *p)
+{
+	return reinterpret_cast<const uint8_t *>(p);
+}
+
+static uint8_t *
+u8(std::byte *p)
+{
+	return reinterpret_cast<uint8_t *>(p);
+}
+
+int
+main(void)
+{
+	static constexpr std::array<uint8_t, 16> raw_key = {
+		0xC2, 0x1F, 0xCF, 0x38, 0x81, 0xCD, 0x5E, 0xE8,
+		0x62, 0x8A, 0xCC, 0xB0, 0xA9, 0x89, 0x0D, 0xF8 };
+	rabbit::key_type key;
+	rabbit::iv_type iv = { std::byte(0x59), std::byte(0x7E), std::byte(0x26), std::byte(0xC1),
+			       std::byte(0x75), std::byte(0xF5), std::byte(0x73), std::byte(0xC3) };
+	struct rabbit_context ctx;
+	struct rabbit_master m;
+	int fail = 0;
+	std::size_t i;
+
+	for(i = 0; i < 16; i++)
+		key[i] = std::byte(raw_key[i]);
+	for(i = 0; i < LEN; i++)
+		in[i] = std::byte(i * 7 + 3);
+
+	// crypt and crypt_stream after a move, the source is wiped
+	{
+		rabbit_set_key_and_iv(&ctx, raw_key.data(), 16, u8(iv.data()), 8);
+		rabbit_crypt(&ctx, u8(in), 1000, u8(a));
+		rabbit_crypt_stream(&ctx, u8(in) + 1000, 777, u8(a) + 1000);
+		rabbit_crypt_stream(&ctx, u8(in) + 1777, 23, u8(a) + 1777);
+
+		rabbit::stream s(key, iv);
+		rabbit::stream t(std::move(s));
+		const uint8_t zero[sizeof(struct rabbit_context)] = { 0 };
+
+		t.crypt(std::span(in).first(1000), std::span(b));
+		t.crypt_stream(std::span(in).subspan(1000, 777), std::span(b).subspan(1000));
+		std::memcpy(b + 1777, in + 1777, 23);
+		t.crypt_stream(std::span(b).subspan(1777, 23));
+		fail |= check("stream crypt", a, b, 1800);
+		fail |= check("stream move", s.native(), zero, sizeof(zero));
+	}
+
+	// cryptv, keystream, skip and iv
+	{
+		struct iovec vin[2] = { { in, 100 }, { in + 100, 900 } };
+		struct iovec vout[3] = { { b, 1 }, { b + 1, 500 }, { b + 501, 499 } };
+		rabbit::master k(key);
+		rabbit::stream s(k, iv);
+
+		rabbit_set_key_and_iv(&ctx, raw_key.data(), 16, u8(iv.data()), 8);
+		rabbit_crypt_stream(&ctx, u8(in), 1000, u8(a));
+		fail |= s.cryptv(vin, vout) ? 0 : 1;
+		fail |= check("stream cryptv", a, b, 1000);
+
+		rabbit_key_setup(&m, raw_key.data(), 16);
+		rabbit_iv_setup(&ctx, &m, u8(iv.data()), 8);
+		rabbit_skip(&ctx, 3);
+		rabbit_keystream(&ctx, u8(a), 64);
+		s.iv(k, iv);
+		s.skip(3);
+		s.keystream(std::span(b).first(64));
+		fail |= check("stream keystream", a, b, 64);
+
+		// The master is wiped by a move like the stream
+		rabbit::master k2(std::move(k));
+		const uint8_t zero[sizeof(struct rabbit_master)] = { 0 };
+
+		fail |= check("master move", &k.native(), zero, sizeof(zero));
+		fail |= check("master", &k2.native(), &m, sizeof(m));
+	}
+
+	// Master state computed at compile time
+	{
+		static constexpr struct rabbit_master master = rabbit::key_schedule(raw_key);
+		rabbit::stream s(master, iv);
+
+		rabbit_set_key_and_iv(&ctx, raw_key.data(), 16, u8(iv.data()), 8);
+		rabbit_crypt(&ctx, u8(in), 1000, u8(a));
+		s.crypt(std::span(in).first(1000), std::span(b));
+		fail |= check("stream master", a, b, 1000);
+	}
+
+	// setup_bulk over more streams than the SIMD lanes
+	{
+		std::array<rabbit::stream, 20> s;
+		std::array<rabbit::key_type, 20> keys;
+		std::array<rabbit::iv_type, 20> ivs;
+
+		for(i = 0; i < 20; i++) {
+			keys[i] = key;
+			keys[i][0] = std::byte(i);
+			ivs[i] = iv;
+			ivs[i][7] = std::byte(i * 3);
+		}
+
+		rabbit::setup_bulk(s, keys, ivs);
+
+		for(i = 0; i < 20; i++) {
+			rabbit_set_key_and_iv(&ctx, u8(keys[i].data()), 16, u8(ivs[i].data()), 8);
+			rabbit_crypt(&ctx, u8(in), 100, u8(a));
+			s[i].crypt(std::span(in).first(100), std::span(b));
+			fail |= check("setup_bulk", a, b, 100);
+		}
+	}
+
+	// crypt_packets and crypt_sectors under one key schedule
+	{
+		rabbit::master k(key);
+		std::array<rabbit::iv_type, 3> piv = { iv, iv, iv };
+		std::array<std::span<const std::byte>, 3> pin = {
+			std::span<const std::byte>(in).first(10),
+			std::span<const std::byte>(in).subspan(10, 500),
+			std::span<const std::byte>(in).subspan(510, 1) };
+		std::array<std::span<std::byte>, 3> pout = {
+			std::span(b).first(10), std::span(b).subspan(10, 500), std::span(b).subspan(510, 1) };
+
+		piv[1][0] = std::byte(9);
+		piv[2][7] = std::byte(1);
+		rabbit::crypt_packets(k, piv, pin, pout);
+
+		for(i = 0; i < 3; i++) {
+			rabbit_set_key_and_iv(&ctx, raw_key.data(), 16, u8(piv[i].data()), 8);
+			rabbit_crypt(&ctx, u8(pin[i].data()), pin[i].size(), u8(a));
+			fail |= check("crypt_packets", a, pout[i].data(), pin[i].size());
+		}
+
+		rabbit_key_setup(&m, raw_key.data(), 16);
+		rabbit_crypt_sectors(&m, u8(iv.data()), 5, 512, u8(in), 3000, u8(a));
+		rabbit::crypt_sectors<512>(k, iv, 5, std::span(in).first(3000), std::span(b));
+		fail |= check("crypt_sectors<512>", a, b, 3000);
+
+		rabbit_crypt_sectors(&m, u8(iv.data()), 7, RABBIT_SECTOR_SIZE, u8(in), LEN, u8(a));
+		rabbit::crypt_sectors<>(k, iv, 7, std::span(in), std::span(b));
+		fail |= check("crypt_sectors<>", a, b, LEN);
+	}
+
+	// Every backend against the constexpr core of rabbit_constexpr.hpp
+	// (the SIMD kernels have their own step and schedules): rabbit_crypt,
+	// rabbit_keystream, the bulk setup and the packets in the lanes
+	{
+		static constexpr rabbit::iv_bytes raw_iv = {
+			0x59, 0x7E, 0x26, 0xC1, 0x75, 0xF5, 0x73, 0xC3 };
+		static constexpr struct rabbit_master master = rabbit::key_schedule(raw_key);
+		static constexpr std::array<uint8_t, KS> ks_key = rabbit::keystream<KS>(master);
+		static constexpr std::array<uint8_t, KS> ks_iv = rabbit::keystream<KS>(master, raw_iv);
+		static const char *backends[] = { "scalar", "sse2", "avx2", "avx512" };
+		static uint8_t zero[KS], out[NSTREAMS][KS];
+		std::array<rabbit::key_bytes, NSTREAMS> keys;
+		std::array<rabbit::iv_bytes, NSTREAMS> ivs;
+		std::array<uint8_t, KS> ks;
+		struct rabbit_context bulk[NSTREAMS];
+		const uint8_t *pin[NSTREAMS];
+		uint8_t *pout[NSTREAMS];
+		uint32_t plen[NSTREAMS];
+
+		for(i = 0; i < NSTREAMS; i++) {
+			keys[i] = raw_key;
+			keys[i][0] = i;
+			ivs[i] = raw_iv;
+			ivs[i][7] = i * 3;
+			pin[i] = zero;
+			pout[i] = out[i];
+			plen[i] = KS - i * 37;
+		}
+
+		for(const char *name : backends) {
+			if(rabbit_backend_select(name))
+				continue;
+
+			rabbit_key_setup(&m, raw_key.data(), 16);
+			fail |= check("constexpr key_schedule", &m, &master, sizeof(m));
+
+			rabbit_master_setup(&ctx, &m);
+			rabbit_crypt(&ctx, zero, KS, out[0]);
+			fail |= check("constexpr keystream", out[0], ks_key.data(), KS);
+
+			rabbit_iv_setup(&ctx, &m, raw_iv.data(), 8);
+			rabbit_keystream(&ctx, out[0], KS);
+			fail |= check("constexpr keystream iv", out[0], ks_iv.data(), KS);
+
+			rabbit_setup_bulk(bulk, reinterpret_cast<const uint8_t (*)[16]>(keys.data()),
+				reinterpret_cast<const uint8_t (*)[8]>(ivs.data()), NSTREAMS);
+			for(i = 0; i < NSTREAMS; i++) {
+				rabbit_crypt(&bulk[i], zero, KS, out[i]);
+				ks = rabbit::keystream<KS>(rabbit::key_schedule(keys[i]), ivs[i]);
+				fail |= check("constexpr setup_bulk", out[i], ks.data(), KS);
+			}
+
+			rabbit_crypt_packets(&m, reinterpret_cast<const uint8_t (*)[8]>(ivs.data()), pin, plen, pout, NSTREAMS);
+			for(i = 0; i < NSTREAMS; i++) {
+				ks = rabbit::keystream<KS>(master, ivs[i]);
+				fail |= check("constexpr crypt_packets", out[i], ks.data(), plen[i]);
+			}
+		}
+
+		rabbit_backend_select("auto");
+	}
+
+	printf("C++ interface: %s\n", fail ? "FAIL" : "OK");
+
+	return fail;
+}